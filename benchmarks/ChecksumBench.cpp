@@ -0,0 +1,68 @@
+// Throughput of every checksum kernel against the scalar loop, and of ChecksumWords as the
+// conversion calls it (dispatched kernel, split over the cores for the big images).
+#include "types.hpp"
+#include "Checksum.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Every measurement sums at least this many bytes, so the small images are timed over many runs
+#define BENCH_MIN_BYTES (1ull << 30)
+
+template <typename Sum>
+static double MeasureGBps(size_t size, Sum sum, u32 &result) {
+    size_t runs = max<size_t>(1, BENCH_MIN_BYTES / size);
+    auto start = chrono::steady_clock::now();
+
+    for (size_t i = 0; i < runs; ++i)
+        result += sum();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    return static_cast<double>(size) * runs / seconds / 1e9;
+}
+
+int main(int argc, const char **argv) {
+    size_t maxSize = argc > 1 ? strtoull(argv[1], nullptr, 0) : (64u << 20);
+    vector<ChecksumKernelInfo> kernels = GetChecksumKernels();
+    vector<u8> image(maxSize);
+
+    for (size_t i = 0; i < image.size(); ++i)
+        image[i] = static_cast<u8>(i * 2654435761u >> 24);
+
+    printf("%-10s", "size");
+
+    for (const ChecksumKernelInfo &info : kernels)
+        printf(" %10s", info.name);
+
+    printf(" %10s   (GB/s)\n", "dispatch");
+
+    for (size_t size = 4096; size <= maxSize; size *= 4) {
+        u32 expected = kernels[0].kernel(image.data(), size / 4);
+        u32 result = 0;
+
+        printf("%-10s", (to_string(size >> 10) + " KiB").c_str());
+
+        for (const ChecksumKernelInfo &info : kernels) {
+            if (info.kernel(image.data(), size / 4) != expected) {
+                printf("\n%s doesn't match the scalar loop!\n", info.name);
+                return 1;
+            }
+
+            printf(" %10.2f", MeasureGBps(size, [&] { return info.kernel(image.data(), size / 4); }, result));
+        }
+
+        printf(" %10.2f\n", MeasureGBps(size, [&] { return ChecksumWords(image.data(), size); }, result));
+
+        // Keeps the sums from being optimized away
+        if (result == 0x12345678)
+            printf(" ");
+    }
+
+    return 0;
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include "types.hpp"
 #define _3GX_MAGIC (0x3230303024584733) /* "3GX$0002" */
+#define _3GX_MAGIC_COMPRESSED (0x3330303024584733) /* "3GX$0003", segments may be compressed, see _3gx_Compression */
 
 struct _3gx_Infos {
     enum class Compatibility {
@@ -76,6 +77,51 @@ struct _3gx_Symtable
     u32  nameTableOffset{0};
 } PACKED;
 
+// GNU hash style index of the symbols by name, followed by:
+// u32 bloom[bloomSize], u32 buckets[nbBuckets], u32 hashes[nbSymbols], u32 symbols[nbSymbols]
+// The entries of a bucket are contiguous, the last hash of a chain has its lowest bit set
+// and an empty bucket is 0xFFFFFFFF. symbols[] holds indexes in the symbol table.
+struct _3gx_NameIndex
+{
+    u32  nbBuckets{0};
+    u32  bloomSize{0}; // In words, power of 2
+    u32  bloomShift{0};
+} PACKED;
+
+#define _3GX_ADDR_INDEX_PAGE_SHIFT (12)
+
+// Page index of the symbols by address, followed by u32 pages[nbPages + 1], where pages[p] is
+// the index of the first symbol at or after baseAddress + (p << pageShift). The symbol covering
+// an address of page p is found between pages[p] - 1 and pages[p + 1] - 1.
+struct _3gx_AddrIndex
+{
+    u32  baseAddress{0};
+    u32  pageShift{0};
+    u32  nbPages{0};
+} PACKED;
+
+static inline u32 _3gx_SymbolAddress(const _3gx_Symbol &symbol) {
+    // The lowest bit of a Thumb function address only selects the instruction set
+    return (symbol.flags & _3GX_SYM__THUMB) ? symbol.address & ~1u : symbol.address;
+}
+
+static inline u32 _3gx_NameHash(const char *name) {
+    u32 hash = 5381;
+
+    for (const u8 *c = reinterpret_cast<const u8 *>(name); *c; ++c)
+        hash = hash * 33 + *c;
+
+    return hash;
+}
+
+static inline u32 _3gx_NameBloomWord(const _3gx_NameIndex &index, u32 hash) {
+    return (hash / 32) & (index.bloomSize - 1);
+}
+
+static inline u32 _3gx_NameBloomMask(const _3gx_NameIndex &index, u32 hash) {
+    return BIT(hash % 32) | BIT((hash >> index.bloomShift) % 32);
+}
+
 struct _3gx_Executable {
     u32 codeOffset{0};
     u32 rodataOffset{0};
@@ -89,12 +135,30 @@ struct _3gx_Executable {
     u32 swapDecOffset{0}; // NOP terminated
 } PACKED;
 
+// Only meaningful with _3GX_MAGIC_COMPRESSED. A segment with a non-zero compressed size is
+// stored at its usual offset as an LZ4 block which decodes to the size in _3gx_Executable.
+// The checksum and the decryption apply to the decompressed segments.
+struct _3gx_Compression {
+    u32 codeCompressedSize{0};
+    u32 rodataCompressedSize{0};
+    u32 dataCompressedSize{0};
+} PACKED;
+
 struct _3gx_Header {
     u64 magic{_3GX_MAGIC};
     u32 version{0};
-    u32 reserved{0};
+    u32 extensionSize{0}; // Of the _3gx_HeaderExtension right after the header, 0 (reserved) when there's none
     _3gx_Infos infos{};
     _3gx_Executable executable{};
     _3gx_Targets targets{};
     _3gx_Symtable symtable{};
+} PACKED;
+
+// Only written when an option needs one of its fields, so a plain file keeps the original
+// layout. Fields are only ever appended, those past extensionSize are absent and read as 0.
+struct _3gx_HeaderExtension {
+    u32 nameIndexOffset{0}; // _3gx_NameIndex, 0 if absent
+    u32 addrIndexOffset{0}; // _3gx_AddrIndex, 0 if absent
+    _3gx_Compression compression{};
+    u32 alignment{0}; // File boundary of the segments and the symbol table, 0 if they're only 16 bytes aligned
 } PACKED;
\ No newline at end of file
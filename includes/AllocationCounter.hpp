@@ -0,0 +1,7 @@
+#pragma once
+#include "types.hpp"
+
+// Counts the allocations made through operator new, for --stats. Only part of the tool:
+// a program embedding lib3gx keeps its own allocator.
+void CountAllocations(bool enabled);
+u64 GetAllocationCount(void);
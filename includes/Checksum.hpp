@@ -0,0 +1,22 @@
+#pragma once
+#include "types.hpp"
+#include <vector>
+
+using namespace std;
+
+// Fewest bytes summed by each thread, so several threads only sum images of at least twice
+// this size (8 MiB)
+#define CHECKSUM_PARALLEL_THRESHOLD (4u << 20)
+
+// Wrapping sum of the little endian words of the buffer, the checksum computed by the
+// default decryption payload. Trailing bytes that don't make a whole word are ignored.
+// At most maxThreads threads are used, 0 for one per core.
+u32 ChecksumWords(const void *data, size_t sizeBytes, u32 maxThreads = 0);
+
+struct ChecksumKernelInfo {
+    const char *name;
+    u32 (*kernel)(const u8 *data, size_t words);
+};
+
+// Every kernel the CPU supports, scalar first, so they can be benchmarked against each other
+vector<ChecksumKernelInfo> GetChecksumKernels(void);
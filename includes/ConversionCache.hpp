@@ -0,0 +1,35 @@
+#pragma once
+#include "types.hpp"
+#include "FileImage.hpp"
+#include <string>
+
+using namespace std;
+
+// Bump whenever the same inputs and options convert to different bytes
+#define CONVERSION_CACHE_VERSION (2)
+
+// Directory of converted files named after the hash of everything their conversion depends
+// on. Entries are published with an atomic rename and looked up without any lock, so several
+// processes can share a cache; only the eviction is serialized through a lock file.
+class ConversionCache {
+public:
+    // A maxSize of 0 never evicts anything
+    ConversionCache(const string &directory, u64 maxSize);
+
+    // Copies the entry to outputPath, false if there's no such entry. The output never
+    // shares the entry's inode. With onlyIfChanged, an output already holding the entry
+    // is left untouched, modification time included.
+    bool Fetch(u64 key, const string &outputPath, bool onlyIfChanged = false) const;
+    // Writes the entry to a stream such as stdout, false if there's no such entry
+    bool FetchToFd(u64 key, int fd) const;
+    // Failures are reported but not fatal, the cache is only an optimization
+    bool Store(u64 key, const FileImage &image) const;
+    // Deletes the least recently used entries until the cache fits in maxSize
+    void Evict(void) const;
+
+private:
+    string _directory;
+    u64 _maxSize;
+
+    string _EntryPath(u64 key) const;
+};
@@ -0,0 +1,73 @@
+#pragma once
+#include "types.hpp"
+#include "3gx.hpp"
+#include "ElfConvert.hpp"
+#include "EncLib.hpp"
+#include "FileImage.hpp"
+#include "Hash.hpp"
+#include "Stats.hpp"
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct PluginInfos {
+    string author;
+    string title;
+    string summary;
+    string description;
+    vector<u32> targets;
+};
+
+// The plugin settings as the conversion uses them
+struct PluginSettings {
+    u32 version{0};
+    u32 flags{0}; ///< _3gx_Infos::flags
+    PluginInfos infos;
+    string warnings; ///< About the missing or invalid entries
+};
+
+// Reads a .plginfo
+PluginSettings ParseSettings(istream &settingsFile);
+PluginSettings LoadSettingsFile(const string &settingsPath);
+
+// A single conversion, which owns or shares everything it depends on. Nothing it uses is
+// process-wide, so any number of contexts can convert concurrently.
+class ConvertContext {
+public:
+    // encLib may be null to use the default payloads
+    ConvertContext(const ConvertOptions &options, shared_ptr<const PluginSettings> settings, shared_ptr<const EncLib> encLib);
+
+    ConvertContext(const ConvertContext &) = delete;
+    ConvertContext &operator=(const ConvertContext &) = delete;
+
+    // The warnings about the executable are written to log
+    void LoadElf(const string &elfPath, ostream &log);
+    // Same from memory, the buffer must outlive the context
+    void LoadElf(const void *elfData, size_t elfSize, ostream &log);
+
+    // Everything the output depends on
+    void HashInputs(Hasher &hasher) const;
+
+    // Lays the whole file out. The image references the context, which must outlive it.
+    const FileImage &Convert(void);
+
+    const ConvertOptions &GetOptions(void) const { return _options; }
+    const _3gx_Header &GetHeader(void) const { return _header; }
+    // All 0 unless the header has an extension
+    const _3gx_HeaderExtension &GetHeaderExtension(void) const { return _headerExtension; }
+    u32 GetTrimmedDataSize(void) const { return _elf ? _elf->GetTrimmedDataSize() : 0; }
+    ConvertStats GetStats(void) const { return _elf ? _elf->GetStats() : ConvertStats(); }
+
+private:
+    ConvertOptions _options;
+    shared_ptr<const PluginSettings> _settings;
+    shared_ptr<const EncLib> _encLib;
+    unique_ptr<ElfConvert> _elf;
+    _3gx_Header _header;
+    _3gx_HeaderExtension _headerExtension;
+    FileImage _image;
+    bool _converted{false};
+};
@@ -0,0 +1,23 @@
+#pragma once
+#include "types.hpp"
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Clients find the daemon through this environment variable
+#define DAEMON_SOCKET_ENV "GXTOOL_SOCKET"
+
+// Runs a request given its command line, with cout and cerr captured, and returns the exit code
+typedef function<int(const vector<string> &args)> DaemonHandler;
+
+// Serves the requests sent to the Unix socket one after another, in the working directory of
+// their client, so whatever the handler keeps loaded is reused. Requests from another version
+// or build of the tool are refused, as are clients stalling mid-request. Only returns on error.
+int RunDaemon(const string &socketPath, const string &version, const DaemonHandler &handler);
+
+// Runs the command line in the daemon listening on the socket and replays its output. Returns
+// false, without side effects, if no daemon of this build is listening so the caller can do
+// the work itself.
+bool ForwardToDaemon(const string &socketPath, const string &version, const vector<string> &args, int &exitCode);
@@ -3,8 +3,12 @@
 #include "types.hpp"
 #include "elf.hpp"
 #include "3gx.hpp"
+#include "EncLib.hpp"
+#include "FileImage.hpp"
+#include "Hash.hpp"
+#include "MappedFile.hpp"
+#include "Stats.hpp"
 #include <iostream>
-#include <fstream>
 #include <string>
 #include <vector>
 
@@ -18,24 +22,50 @@ struct SegConv {
     u32 memPos;
 };
 
+struct ConvertOptions {
+    bool writeSymbols{true};
+    bool writeNameIndex{false}; ///< Emit the _3gx_NameIndex after the symbol names
+    bool writeAddrIndex{false}; ///< Emit the _3gx_AddrIndex after the symbol names
+    bool compress{false}; ///< Compress the segments, which requires a loader supporting _3GX_MAGIC_COMPRESSED
+    bool trimData{false}; ///< Move the trailing zeroes of the data segment to the bss
+    u32 alignment{0}; ///< Power of 2 the segments and the symbol table are aligned to in the file, 0 for the legacy layout
+    u32 parallelSymbolsThreshold{0x10000}; ///< Symbol tables this big are processed on every core, 0 to disable
+    u32 maxThreads{0}; ///< Threads a single conversion may split its work over, 0 for one per core
+};
+
 class ElfConvert {
 public:
-    ElfConvert(const string &elfPath);
+    // The warnings about the executable are written to log
+    ElfConvert(const string &elfPath, ostream &log);
+    // The executable is only referenced, it must outlive the conversion and its image
+    ElfConvert(const void *elfData, size_t elfSize, ostream &log);
     ~ElfConvert(void);
-    void WriteToFile(_3gx_Header &header, ofstream &outFile, bool writeSymbols);
+    // Lays the payloads, segments and symbols out into the image and fills the header accordingly
+    void WriteToImage(_3gx_Header &header, _3gx_HeaderExtension &extension, FileImage &image, const ConvertOptions &options, const EncLib *encLib);
+
+    // Feeds everything the conversion reads from the ELF: the loadable segments and the symbols
+    void HashContents(Hasher &hasher) const;
+
+    // Bytes of the data segment moved to the bss by ConvertOptions::trimData
+    u32 GetTrimmedDataSize(void) const { return _trimmedDataSize; }
+    // Time spent in each phase so far, bytes read and symbol counts
+    const ConvertStats &GetStats(void) const { return _stats; }
 
 private:
-    char *_img{nullptr};
+    MappedFile _file;
+    const char *_img{nullptr};
     uint8_t *_binaryBuff{nullptr};
     int _platFlags{0};
 
-    Elf32_Shdr *_elfSects{nullptr};
+    const Elf32_Shdr *_elfSects{nullptr};
     int _elfSectCount{0};
     const char *_elfSectNames{nullptr};
 
-    Elf32_Sym *_elfSyms{nullptr};
+    const Elf32_Shdr *_elfSymSect{nullptr};
+    const Elf32_Sym *_elfSyms{nullptr};
     int _elfSymCount{0};
     const char *_elfSymNames{nullptr};
+    u32 _elfSymNamesSize{0};
 
     u32 _baseAddr{0};
     u32 _topAddr{0};
@@ -47,10 +77,26 @@ private:
     u32 _rodataSegSize{0};
     u32 _dataSegSize{0};
     u32 _bssSize{0};
+    u32 _trimmedDataSize{0};
+
+    vector<u8> _codeSegCompressed;
+    vector<u8> _rodataSegCompressed;
+    vector<u8> _dataSegCompressed;
 
     vector<_3gx_Symbol> _symbols;
     vector<char> _symbolsNames;
+    vector<u32> _symbolsNameHashes;
+    vector<u32> _nameIndex;
+    vector<u32> _addrIndex;
+    ConvertStats _stats;
 
-    void _GetSymbols(void);
-    void _AddSymbol(Elf32_Sym *symbol, u16 flags);
+    void _Load(ostream &log);
+    void _TrimData(void);
+    static void _AlignImage(FileImage &image, const ConvertOptions &options);
+    void _FindSymbolTable(void);
+    void _FilterSymbols(u32 first, u32 last, vector<u64> &keys) const;
+    vector<u64> _GetSortedSymbolKeys(u32 parallelThreshold, u32 maxThreads) const;
+    void _RemoveDuplicateSymbols(vector<const Elf32_Sym *> &symbols, vector<u32> &nameHashes) const;
+    void _GetSymbols(u32 parallelThreshold, u32 maxThreads);
+    void _AddSymbol(const Elf32_Sym *symbol, u16 flags, u32 nameOffset);
 };
\ No newline at end of file
@@ -0,0 +1,31 @@
+#pragma once
+#include "types.hpp"
+#include <string>
+
+using namespace std;
+
+// Encryption shared library, exporting encrypt, decryptPayload and encryptDecryptSwapPayload.
+// Instances are immutable once loaded, so a conversion can share one with others.
+class EncLib {
+public:
+    explicit EncLib(const string &path);
+    ~EncLib(void);
+
+    EncLib(const EncLib &) = delete;
+    EncLib &operator=(const EncLib &) = delete;
+
+    // Encrypts the executable in place and returns its checksum
+    u32 Encrypt(void *executable, u32 size, u32 params[4]) const;
+    // Payloads run by the loader, false if the library doesn't provide them
+    bool GetDecryptPayload(u32 payload[32], u32 params[4]) const;
+    bool GetSwapPayloads(u32 encPayload[32], u32 decPayload[32], u32 params[4]) const;
+
+    const string &GetPath(void) const { return _path; }
+    // Hash of the library file, which identifies it in the conversion cache
+    u64 GetHash(void) const { return _hash; }
+
+private:
+    string _path;
+    u64 _hash{0};
+    void *_library{nullptr}; ///< dynalo::library, only known to EncLib.cpp
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include "types.hpp"
+#include <deque>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Layout of an output file as a list of chunks. The offset of a chunk is known as soon
+// as it's appended, so headers can be filled before anything is written, then the
+// whole file is emitted at once with a scatter-gather write.
+class FileImage {
+public:
+    // The data is referenced, not copied: it must outlive the image
+    u32 Append(const void *data, u32 size);
+    u32 AppendCopy(const void *data, u32 size);
+    u32 AppendZeroes(u32 size);
+    // Pads the image to a multiple of alignment, which must be a power of 2
+    u32 Align(u32 alignment);
+
+    u32 Size(void) const { return _size; }
+
+    // Flattens the image into buffer, which must hold Size() bytes
+    void CopyTo(void *buffer) const;
+
+    void WriteToFile(const string &path) const;
+    void WriteToFd(int fd) const;
+    // Leaves the file and its modification time alone if it already holds the image,
+    // otherwise replaces it atomically. Returns whether the file was written.
+    bool WriteToFileIfChanged(const string &path) const;
+    // Whether the file holds exactly the image
+    bool Matches(const string &path) const;
+
+    // Name to write path under before renaming it, unique among threads and processes
+    static string TempPath(const string &path);
+
+private:
+    struct Chunk {
+        const u8 *data;
+        u32 size;
+    };
+
+    vector<Chunk> _chunks;
+    deque<vector<u8>> _storage;
+    u32 _size{0};
+};
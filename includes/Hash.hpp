@@ -0,0 +1,26 @@
+#pragma once
+#include "types.hpp"
+#include <string>
+
+using namespace std;
+
+// Streaming XXH64, fast enough to fingerprint a whole executable on every run. It's meant
+// for content addressing, not for security.
+class Hasher {
+public:
+    explicit Hasher(u64 seed = 0);
+
+    void Update(const void *data, size_t size);
+    void UpdateWord(u32 value);
+    // Length prefixed, so consecutive strings can't be confused
+    void UpdateString(const string &value);
+
+    u64 Digest(void) const;
+
+private:
+    u64 _seed;
+    u64 _lanes[4];
+    u8 _stripe[32];
+    u32 _stripeSize{0};
+    u64 _totalSize{0};
+};
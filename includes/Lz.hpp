@@ -0,0 +1,15 @@
+#pragma once
+#include "types.hpp"
+#include <vector>
+
+using namespace std;
+
+// LZ4 block format: a sequence is a token (literal count << 4 | match length - 4), the
+// extra literal count bytes, the literals, a 16-bit little endian match offset and the
+// extra match length bytes. The last sequence only has literals. Decoding is a byte
+// loop with no state, which suits the ARM11 loader.
+
+vector<u8> LzCompress(const u8 *src, size_t srcSize);
+
+// Reference decompressor, returns false if the data is malformed or doesn't decode to exactly dstSize bytes
+bool LzDecompress(const u8 *src, size_t srcSize, u8 *dst, size_t dstSize);
@@ -0,0 +1,35 @@
+#pragma once
+#include "types.hpp"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Read-only view of a whole file: regular files are memory-mapped so only the touched
+// pages are ever read, anything else (pipes, character devices) is read into a buffer.
+// The path "-" stands for stdin.
+class MappedFile {
+public:
+    explicit MappedFile(const string &path);
+    // View of a buffer owned by the caller, which must outlive the instance
+    MappedFile(const void *data, size_t size);
+    ~MappedFile(void);
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *Data(void) const { return _data; }
+    size_t Size(void) const { return _size; }
+    bool IsMapped(void) const { return _mapping != nullptr; }
+
+    // Hint that the range will be read soon, no-op for buffered files
+    void WillNeed(size_t offset, size_t size) const;
+
+private:
+    const char *_data{nullptr};
+    size_t _size{0};
+    void *_mapping{nullptr};
+    vector<char> _buffer;
+
+    void _ReadBuffered(int fd);
+};
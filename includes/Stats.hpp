@@ -0,0 +1,78 @@
+#pragma once
+#include "types.hpp"
+#include <iostream>
+
+using namespace std;
+
+enum class StatsPhase : u32 {
+    ElfRead,
+    YamlLoad,
+    EncLibLoad,
+    Encrypt, ///< Encryption or checksum of the executable
+    SegmentWrite, ///< Payloads and segments laid out, compression included
+    GetSymbols,
+    SymbolWrite, ///< Symbol table and indexes laid out
+    OutputWrite,
+    Count
+};
+
+struct PhaseStats {
+    u64 wallNs{0};
+    u64 cpuNs{0}; ///< Of the thread running the phase
+    u32 count{0};
+};
+
+// What the conversions cost, summed over all of them
+struct ConvertStats {
+    PhaseStats phases[static_cast<u32>(StatsPhase::Count)];
+    u32 conversions{0};
+    u32 cacheHits{0};
+    u64 bytesRead{0};
+    u64 bytesWritten{0};
+    u64 elfSymbols{0}; ///< Entries of the ELF symtab
+    u64 filteredSymbols{0}; ///< Left once the irrelevant ones are filtered out
+    u64 uniqueSymbols{0}; ///< Left once the duplicates are removed
+    u64 writtenSymbols{0};
+
+    PhaseStats &Phase(StatsPhase phase) { return phases[static_cast<u32>(phase)]; }
+    const PhaseStats &Phase(StatsPhase phase) const { return phases[static_cast<u32>(phase)]; }
+
+    void Merge(const ConvertStats &other);
+};
+
+// Measured over a whole run, not per conversion
+struct ProcessStats {
+    u64 wallNs{0};
+    u64 cpuNs{0};
+    u64 peakRssKiB{0};
+    u64 allocations{0};
+};
+
+// Adds the time spent in its scope to a phase, and records it in the trace
+class PhaseTimer {
+public:
+    PhaseTimer(ConvertStats &stats, StatsPhase phase);
+    ~PhaseTimer(void);
+
+    PhaseTimer(const PhaseTimer &) = delete;
+    PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+    // Ends the current phase, if any, and starts the next one
+    void Next(StatsPhase phase);
+    void Stop(void);
+
+private:
+    ConvertStats &_stats;
+    PhaseStats *_phase{nullptr};
+    u64 _wallStart{0};
+    u64 _cpuStart{0};
+};
+
+u64 GetWallTimeNs(void);
+u64 GetThreadCpuTimeNs(void);
+u64 GetProcessCpuTimeNs(void);
+// 0 where it can't be measured
+u64 GetPeakRssKiB(void);
+
+void WriteStatsTable(ostream &out, const ConvertStats &stats, const ProcessStats &process);
+void WriteStatsJson(ostream &out, const ConvertStats &stats, const ProcessStats &process);
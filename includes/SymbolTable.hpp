@@ -0,0 +1,57 @@
+#pragma once
+#include "types.hpp"
+#include "3gx.hpp"
+#include <vector>
+
+using namespace std;
+
+// Serializes the _3gx_NameIndex of a symbol table, given the name hash of every symbol
+vector<u32> BuildNameIndex(const vector<u32> &nameHashes);
+
+// Serializes the _3gx_AddrIndex of an address sorted symbol table over [baseAddress, topAddress)
+vector<u32> BuildAddrIndex(const vector<_3gx_Symbol> &symbols, u32 baseAddress, u32 topAddress);
+
+// Read-only view of the symbols of a 3GX file held in memory
+class SymbolTable {
+public:
+    SymbolTable(const void *file, size_t size);
+
+    u32 Count(void) const { return _count; }
+    _3gx_Symbol Get(u32 index) const;
+    const char *GetName(u32 index) const;
+
+    bool HasNameIndex(void) const { return _bloom != nullptr; }
+    bool HasAddrIndex(void) const { return _pages != nullptr; }
+
+    // Index of the first symbol with that name, -1 if there's none.
+    // Goes through the name index when the file has one, otherwise scans the table.
+    s32 FindByName(const char *name) const;
+
+    // Index of the symbol the address belongs to: the last one starting at or before it,
+    // reported under its main name rather than an alias. -1 if the address is before every symbol.
+    // Goes through the address index when the file has one, otherwise does a binary search.
+    s32 FindByAddress(u32 address) const;
+
+private:
+    const u8 *_file{nullptr};
+    size_t _size{0};
+    u32 _count{0};
+    const u8 *_symbols{nullptr};
+    const char *_names{nullptr};
+    size_t _namesSize{0};
+
+    _3gx_NameIndex _nameIndex{};
+    const u8 *_bloom{nullptr};
+    const u8 *_buckets{nullptr};
+    const u8 *_hashes{nullptr};
+    const u8 *_indexes{nullptr};
+
+    _3gx_AddrIndex _addrIndex{};
+    const u8 *_pages{nullptr};
+
+    // Start address of every symbol, Thumb bit cleared, for the address lookups
+    vector<u32> _addresses;
+
+    const u8 *_Range(u32 offset, u64 size) const;
+    void _LoadNameIndex(u32 indexOffset);
+};
@@ -0,0 +1,12 @@
+#pragma once
+#include "types.hpp"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Resolves the addresses listed one per line in addressesPath ("-" for stdin) against the
+// symbols of the given 3GX files, and prints "<line> <symbol>+<offset>" for each of them.
+// A line is either "<address>", resolved in the first plugin, or "<plugin> <address>" where
+// the plugin is given by its path or file name.
+int RunSymbolize(const vector<string> &pluginPaths, const string &addressesPath, u32 threadCount);
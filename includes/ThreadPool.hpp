@@ -0,0 +1,45 @@
+#pragma once
+#include "types.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Work-stealing pool: every worker owns a queue, pops its own work from the back
+// and steals from the front of the other queues when it runs dry.
+class ThreadPool {
+public:
+    explicit ThreadPool(u32 threadCount = 0);
+    ~ThreadPool(void);
+
+    void Submit(function<void()> task);
+    void Wait(void);
+    u32 GetThreadCount(void) const { return static_cast<u32>(_threads.size()); }
+
+private:
+    struct WorkQueue {
+        mutex lock;
+        deque<function<void()>> tasks;
+    };
+
+    vector<unique_ptr<WorkQueue>> _queues;
+    vector<thread> _threads;
+
+    mutex _lock;
+    condition_variable _wake;
+    condition_variable _idle;
+    atomic<u32> _queued{0};
+    atomic<u32> _nextQueue{0};
+    u32 _pending{0};
+    bool _stop{false};
+
+    bool _Pop(u32 index, function<void()> &task);
+    bool _Steal(u32 index, function<void()> &task);
+    void _WorkerLoop(u32 index);
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include "types.hpp"
+#include <string>
+
+using namespace std;
+
+// Timeline of the conversions, written as Chrome trace events (chrome://tracing, Perfetto).
+// Each thread records into its own ring buffer, without any lock, and the oldest events
+// are dropped once it's full. Nothing is recorded until StartTrace.
+
+// To be called while no other thread records
+void StartTrace(void);
+bool IsTracing(void);
+// Stops the recording and writes everything recorded since StartTrace
+bool WriteTrace(const string &path);
+
+// Records a span on the current thread, the times coming from GetWallTimeNs. The name must
+// outlive the trace, it's usually a literal.
+void TraceComplete(const char *name, u64 startNs, u64 endNs);
+
+// Records its scope
+class TraceSpan {
+public:
+    explicit TraceSpan(const char *name);
+    ~TraceSpan(void);
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    const char *_name;
+    u64 _start{0};
+};
+
+// Tags the spans recorded by the current thread in its scope with an input file
+class TraceFileScope {
+public:
+    explicit TraceFileScope(const string &file);
+    ~TraceFileScope(void);
+
+    TraceFileScope(const TraceFileScope &) = delete;
+    TraceFileScope &operator=(const TraceFileScope &) = delete;
+
+private:
+    u32 _previous;
+};
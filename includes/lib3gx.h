@@ -0,0 +1,113 @@
+/* lib3gx: converts a plugin ELF to a .3gx in memory.
+ *
+ * This is the stable C ABI of the library: the structures only ever grow at their end and
+ * start with their own size, so a program built against an older header keeps working
+ * with a newer library. Every string and buffer returned is released with lib3gx_free.
+ */
+#ifndef LIB3GX_H
+#define LIB3GX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32) && !defined(LIB3GX_STATIC)
+#  ifdef LIB3GX_BUILD
+#    define LIB3GX_API __declspec(dllexport)
+#  else
+#    define LIB3GX_API __declspec(dllimport)
+#  endif
+#elif defined(__GNUC__) && defined(LIB3GX_BUILD)
+#  define LIB3GX_API __attribute__((visibility("default")))
+#else
+#  define LIB3GX_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LIB3GX_ABI_VERSION 1
+
+/* Results */
+#define LIB3GX_OK 0
+#define LIB3GX_ERROR_ARGUMENT 1 /* A required pointer is missing or a value is out of range */
+#define LIB3GX_ERROR_SETTINGS 2 /* The YAML settings couldn't be parsed */
+#define LIB3GX_ERROR_CONVERSION 3 /* The ELF couldn't be converted */
+#define LIB3GX_ERROR_ENCLIB 4 /* The encryption library couldn't be loaded */
+#define LIB3GX_ERROR_MEMORY 5
+
+/* lib3gx_options::flags */
+#define LIB3GX_DISCARD_SYMBOLS (1u << 0)
+#define LIB3GX_NAME_INDEX (1u << 1) /* Same as --name-index */
+#define LIB3GX_ADDR_INDEX (1u << 2) /* Same as --addr-index */
+#define LIB3GX_COMPRESS (1u << 3) /* Same as --compress */
+#define LIB3GX_TRIM_DATA (1u << 4) /* Same as --trim-data */
+
+typedef struct lib3gx_options {
+    uint32_t size; /* sizeof(lib3gx_options) */
+    uint32_t flags; /* LIB3GX_DISCARD_SYMBOLS... */
+    uint32_t alignment; /* Same as --align, 0 for the legacy layout */
+} lib3gx_options;
+
+/* lib3gx_settings::compatibility */
+#define LIB3GX_COMPAT_CONSOLE 0
+#define LIB3GX_COMPAT_CITRA 1
+#define LIB3GX_COMPAT_ANY 2
+
+/* lib3gx_settings::memory_size */
+#define LIB3GX_MEMORY_5MIB 0
+#define LIB3GX_MEMORY_2MIB 1
+#define LIB3GX_MEMORY_10MIB 2
+
+/* lib3gx_settings::flags */
+#define LIB3GX_EVENTS_SELF_MANAGED (1u << 0)
+#define LIB3GX_SWAP_NOT_NEEDED (1u << 1)
+
+/* The contents of a .plginfo */
+typedef struct lib3gx_settings {
+    uint32_t size; /* sizeof(lib3gx_settings) */
+    uint32_t version_major;
+    uint32_t version_minor;
+    uint32_t version_revision;
+    const char *author; /* NULL or empty when missing */
+    const char *title;
+    const char *summary;
+    const char *description;
+    const uint32_t *targets; /* Title ids, none for every title */
+    uint32_t target_count;
+    uint32_t compatibility; /* LIB3GX_COMPAT_... */
+    uint32_t memory_size; /* LIB3GX_MEMORY_... */
+    uint32_t flags; /* LIB3GX_EVENTS_SELF_MANAGED... */
+} lib3gx_settings;
+
+/* A loaded encryption library. It can be shared by any number of concurrent conversions. */
+typedef struct lib3gx_enclib lib3gx_enclib;
+
+/* Version of the ABI the library implements */
+LIB3GX_API uint32_t lib3gx_abi_version(void);
+
+LIB3GX_API int lib3gx_enclib_open(const char *path, lib3gx_enclib **enclib, char **error);
+LIB3GX_API void lib3gx_enclib_close(lib3gx_enclib *enclib);
+
+/* Converts the ELF, whose size is elf_size. options may be NULL for the defaults and
+ * enclib NULL for the default payloads. On success *output holds the plugin, which is
+ * *output_size bytes long. messages, when not NULL, receives the warnings on success
+ * and the error otherwise, or NULL if there is nothing to report.
+ *
+ * Conversions don't share any state, so they may run concurrently on different threads. */
+LIB3GX_API int lib3gx_convert(const void *elf, size_t elf_size, const lib3gx_settings *settings,
+    const lib3gx_options *options, const lib3gx_enclib *enclib,
+    void **output, size_t *output_size, char **messages);
+
+/* Same with the settings as the YAML contents of a .plginfo, settings_size bytes long */
+LIB3GX_API int lib3gx_convert_yaml(const void *elf, size_t elf_size, const char *settings, size_t settings_size,
+    const lib3gx_options *options, const lib3gx_enclib *enclib,
+    void **output, size_t *output_size, char **messages);
+
+LIB3GX_API void lib3gx_free(void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIB3GX_H */
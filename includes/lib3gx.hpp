@@ -0,0 +1,18 @@
+#pragma once
+#include "types.hpp"
+#include "ConvertContext.hpp"
+#include "EncLib.hpp"
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// In-memory conversions, the C++ API of lib3gx. ConvertContext gives finer control,
+// e.g. to hash the inputs first. encLib may be null to use the default payloads.
+vector<u8> ConvertToBuffer(const void *elfData, size_t elfSize, const PluginSettings &settings,
+    const ConvertOptions &options, shared_ptr<const EncLib> encLib, ostream &log);
+// The settings are the contents of a .plginfo, their warnings are written to log
+vector<u8> ConvertToBuffer(const void *elfData, size_t elfSize, const string &settingsYaml,
+    const ConvertOptions &options, shared_ptr<const EncLib> encLib, ostream &log);
@@ -0,0 +1,38 @@
+#include "AllocationCounter.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+// Off by default, so the allocations only pay for a relaxed load
+static atomic<bool> g_countAllocations{false};
+static atomic<u64> g_allocationCount{0};
+
+void CountAllocations(bool enabled) {
+    g_countAllocations = enabled;
+}
+
+u64 GetAllocationCount(void) {
+    return g_allocationCount.load();
+}
+
+void *operator new(size_t size) {
+    if (g_countAllocations.load(memory_order_relaxed))
+        g_allocationCount.fetch_add(1, memory_order_relaxed);
+
+    void *ptr = malloc(size ? size : 1);
+
+    if (!ptr)
+        throw bad_alloc();
+
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
@@ -0,0 +1,171 @@
+#include "Checksum.hpp"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CHECKSUM_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+typedef u32 (*ChecksumKernel)(const u8 *data, size_t words);
+
+static u32 ChecksumScalar(const u8 *data, size_t words) {
+    u32 ret = 0;
+
+    for (u32 word; words--; data += sizeof(u32)) {
+        memcpy(&word, data, sizeof(u32));
+        ret += le_word(word);
+    }
+
+    return ret;
+}
+
+#ifdef CHECKSUM_X86
+// x86 is little endian, the lanes can be summed as is. Each kernel keeps four
+// accumulators to hide the add latency and leaves the remaining words to the scalar loop.
+
+__attribute__((target("sse2")))
+static u32 ChecksumSSE2(const u8 *data, size_t words) {
+    __m128i acc0 = _mm_setzero_si128(), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+    size_t blocks = words / 16;
+
+    for (size_t i = 0; i < blocks; ++i, data += 64) {
+        acc0 = _mm_add_epi32(acc0, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data)));
+        acc1 = _mm_add_epi32(acc1, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16)));
+        acc2 = _mm_add_epi32(acc2, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 32)));
+        acc3 = _mm_add_epi32(acc3, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 48)));
+    }
+
+    __m128i acc = _mm_add_epi32(_mm_add_epi32(acc0, acc1), _mm_add_epi32(acc2, acc3));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    return static_cast<u32>(_mm_cvtsi128_si32(acc)) + ChecksumScalar(data, words % 16);
+}
+
+__attribute__((target("avx2")))
+static u32 ChecksumAVX2(const u8 *data, size_t words) {
+    __m256i acc0 = _mm256_setzero_si256(), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+    size_t blocks = words / 32;
+
+    for (size_t i = 0; i < blocks; ++i, data += 128) {
+        acc0 = _mm256_add_epi32(acc0, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data)));
+        acc1 = _mm256_add_epi32(acc1, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + 32)));
+        acc2 = _mm256_add_epi32(acc2, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + 64)));
+        acc3 = _mm256_add_epi32(acc3, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + 96)));
+    }
+
+    __m256i acc = _mm256_add_epi32(_mm256_add_epi32(acc0, acc1), _mm256_add_epi32(acc2, acc3));
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    return static_cast<u32>(_mm_cvtsi128_si32(half)) + ChecksumScalar(data, words % 32);
+}
+
+__attribute__((target("avx512f")))
+static u32 ChecksumAVX512(const u8 *data, size_t words) {
+    __m512i acc0 = _mm512_setzero_si512(), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+    size_t blocks = words / 64;
+
+    for (size_t i = 0; i < blocks; ++i, data += 256) {
+        acc0 = _mm512_add_epi32(acc0, _mm512_loadu_si512(data));
+        acc1 = _mm512_add_epi32(acc1, _mm512_loadu_si512(data + 64));
+        acc2 = _mm512_add_epi32(acc2, _mm512_loadu_si512(data + 128));
+        acc3 = _mm512_add_epi32(acc3, _mm512_loadu_si512(data + 192));
+    }
+
+    __m512i acc = _mm512_add_epi32(_mm512_add_epi32(acc0, acc1), _mm512_add_epi32(acc2, acc3));
+    u32 lanes[16], ret = 0;
+
+    _mm512_storeu_si512(lanes, acc);
+
+    for (u32 lane : lanes)
+        ret += lane;
+
+    return ret + ChecksumScalar(data, words % 64);
+}
+#endif
+
+static ChecksumKernel SelectKernel(void) {
+#ifdef CHECKSUM_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f"))
+        return ChecksumAVX512;
+
+    if (__builtin_cpu_supports("avx2"))
+        return ChecksumAVX2;
+
+    if (__builtin_cpu_supports("sse2"))
+        return ChecksumSSE2;
+#endif
+
+    return ChecksumScalar;
+}
+
+vector<ChecksumKernelInfo> GetChecksumKernels(void) {
+    vector<ChecksumKernelInfo> kernels{{"scalar", ChecksumScalar}};
+
+#ifdef CHECKSUM_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("sse2"))
+        kernels.push_back({"sse2", ChecksumSSE2});
+
+    if (__builtin_cpu_supports("avx2"))
+        kernels.push_back({"avx2", ChecksumAVX2});
+
+    if (__builtin_cpu_supports("avx512f"))
+        kernels.push_back({"avx512f", ChecksumAVX512});
+#endif
+
+    return kernels;
+}
+
+u32 ChecksumWords(const void *data, size_t sizeBytes, u32 maxThreads) {
+    static const ChecksumKernel kernel = SelectKernel();
+    const u8 *bytes = static_cast<const u8 *>(data);
+    size_t words = sizeBytes / sizeof(u32);
+
+    // Asking for the core count is a syscall, which costs more than summing a small image
+    if (sizeBytes < 2 * CHECKSUM_PARALLEL_THRESHOLD)
+        return kernel(bytes, words);
+
+    u32 threadCount = maxThreads ? maxThreads : max(1u, thread::hardware_concurrency());
+
+    threadCount = static_cast<u32>(min<size_t>(threadCount, sizeBytes / CHECKSUM_PARALLEL_THRESHOLD));
+
+    if (threadCount <= 1)
+        return kernel(bytes, words);
+
+    // The sum wraps, so the partial sums of each chunk simply add up
+    vector<u32> sums(threadCount, 0);
+    vector<thread> threads;
+    size_t chunkWords = (words + threadCount - 1) / threadCount;
+
+    for (u32 i = 1; i < threadCount; ++i) {
+        size_t first = min(words, i * chunkWords);
+        size_t count = min(words - first, chunkWords);
+
+        threads.emplace_back([&sums, bytes, first, count, i] {
+            sums[i] = kernel(bytes + first * sizeof(u32), count);
+        });
+    }
+
+    sums[0] = kernel(bytes, min(words, chunkWords));
+
+    for (thread &t : threads)
+        t.join();
+
+    u32 ret = 0;
+
+    for (u32 sum : sums)
+        ret += sum;
+
+    return ret;
+}
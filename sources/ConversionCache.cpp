@@ -0,0 +1,214 @@
+#include "ConversionCache.hpp"
+#include "MappedFile.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/time.h>
+#endif
+
+#define die(msg) {throw runtime_error(msg);}
+
+#define ENTRY_EXTENSION ".3gx"
+#define TEMP_MARKER ".tmp" // See FileImage::TempPath
+// Temporary files left by a crashed process are deleted once this old (seconds)
+#define STALE_TEMP_AGE (3600)
+
+ConversionCache::ConversionCache(const string &directory, u64 maxSize) : _directory(directory), _maxSize(maxSize) {
+#ifndef _WIN32
+    if (mkdir(_directory.c_str(), 0777) != 0 && errno != EEXIST)
+        die("Couldn't create the cache directory: " + _directory);
+#else
+    die("The conversion cache isn't supported on this platform!");
+#endif
+}
+
+string ConversionCache::_EntryPath(u64 key) const {
+    char name[17];
+
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+    return _directory + "/" + name + ENTRY_EXTENSION;
+}
+
+bool ConversionCache::Fetch(u64 key, const string &outputPath, bool onlyIfChanged) const {
+#ifndef _WIN32
+    string entryPath = _EntryPath(key);
+    string tempPath = FileImage::TempPath(outputPath);
+    unique_ptr<MappedFile> entry;
+    FileImage copy;
+    struct stat entryStat, outputStat;
+
+    try {
+        entry.reset(new MappedFile(entryPath));
+    }
+
+    catch (exception &) {
+        return false;
+    }
+
+    copy.Append(entry->Data(), entry->Size());
+
+    // Older versions hard linked the outputs to the entries, such an output gets its own copy
+    if (stat(entryPath.c_str(), &entryStat) == 0 && stat(outputPath.c_str(), &outputStat) == 0
+        && entryStat.st_dev == outputStat.st_dev && entryStat.st_ino == outputStat.st_ino)
+        unlink(outputPath.c_str());
+
+    // Never a link: the modification time of the entry is bumped below, and an output may be edited in place
+    try {
+        if (onlyIfChanged)
+            copy.WriteToFileIfChanged(outputPath);
+
+        // The output is replaced at once, so a reader never sees a partial file
+        else {
+            copy.WriteToFile(tempPath);
+
+            if (rename(tempPath.c_str(), outputPath.c_str()) != 0)
+                die("Couldn't write the file: " + outputPath);
+        }
+    }
+
+    catch (exception &) {
+        remove(tempPath.c_str());
+        return false;
+    }
+
+    // The modification time orders the entries for the eviction
+    utimes(entryPath.c_str(), nullptr);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool ConversionCache::FetchToFd(u64 key, int fd) const {
+#ifndef _WIN32
+    string entryPath = _EntryPath(key);
+    unique_ptr<MappedFile> entry;
+    FileImage view;
+
+    try {
+        entry.reset(new MappedFile(entryPath));
+    }
+
+    catch (exception &) {
+        return false;
+    }
+
+    // Once something is written there's no falling back to a conversion, so errors are fatal
+    view.Append(entry->Data(), entry->Size());
+    view.WriteToFd(fd);
+    utimes(entryPath.c_str(), nullptr);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool ConversionCache::Store(u64 key, const FileImage &image) const {
+    string entryPath = _EntryPath(key);
+    string tempPath = FileImage::TempPath(entryPath);
+
+    try {
+        image.WriteToFile(tempPath);
+    }
+
+    catch (exception &) {
+        remove(tempPath.c_str());
+        return false;
+    }
+
+    // Concurrent stores of the same key write the same bytes, whichever wins is fine
+    if (rename(tempPath.c_str(), entryPath.c_str()) != 0) {
+        remove(tempPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+void ConversionCache::Evict(void) const {
+    TraceSpan span("ConversionCache::Evict");
+
+#ifndef _WIN32
+    struct Entry {
+        string path;
+        time_t mtime;
+        u64 size;
+    };
+
+    if (!_maxSize)
+        return;
+
+    string lockPath = _directory + "/.lock";
+    int lockFd = open(lockPath.c_str(), O_RDWR | O_CREAT, 0666);
+
+    if (lockFd < 0)
+        return;
+
+    // Someone else is already evicting, there's no point in scanning twice
+    if (flock(lockFd, LOCK_EX | LOCK_NB) != 0) {
+        close(lockFd);
+        return;
+    }
+
+    DIR *dir = opendir(_directory.c_str());
+    vector<Entry> entries;
+    u64 totalSize = 0;
+    time_t now = time(nullptr);
+
+    if (dir) {
+        while (struct dirent *dirEntry = readdir(dir)) {
+            string name = dirEntry->d_name;
+            string path = _directory + "/" + name;
+            struct stat st;
+
+            if (name[0] == '.' || stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+                continue;
+
+            if (name.find(TEMP_MARKER) != string::npos) {
+                if (now - st.st_mtime > STALE_TEMP_AGE)
+                    remove(path.c_str());
+
+                continue;
+            }
+
+            if (name.size() <= sizeof(ENTRY_EXTENSION) - 1
+                || name.compare(name.size() - (sizeof(ENTRY_EXTENSION) - 1), string::npos, ENTRY_EXTENSION) != 0)
+                continue;
+
+            entries.push_back({path, st.st_mtime, static_cast<u64>(st.st_size)});
+            totalSize += st.st_size;
+        }
+
+        closedir(dir);
+    }
+
+    if (totalSize > _maxSize) {
+        sort(entries.begin(), entries.end(), [](const Entry &left, const Entry &right) {
+            return left.mtime < right.mtime;
+        });
+
+        for (const Entry &entry : entries) {
+            if (totalSize <= _maxSize)
+                break;
+
+            // A fetch racing with this either misses or still copies the entry it mapped
+            if (remove(entry.path.c_str()) == 0)
+                totalSize -= entry.size;
+        }
+    }
+
+    flock(lockFd, LOCK_UN);
+    close(lockFd);
+#endif
+}
@@ -0,0 +1,277 @@
+#include "ConvertContext.hpp"
+#include <yaml.h>
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#define die(msg) {throw runtime_error(msg);}
+
+#define MAKE_VERSION(major, minor, revision) \
+    (((major) << 24)|((minor) << 16)|((revision) << 8))
+
+static u32 GetVersion(YAML::Node &settings) {
+    u32 major = 0, minor = 0, revision = 0;
+
+    if (settings["Version"]) {
+        auto map = settings["Version"];
+
+        if (map["Major"])
+            major = map["Major"].as<u32>();
+
+        if (map["Minor"])
+            minor = map["Minor"].as<u32>();
+
+        if (map["Revision"])
+            revision = map["Revision"].as<u32>();
+    }
+
+    return MAKE_VERSION(major, minor, revision);
+}
+
+static void GetInfos(YAML::Node &settings, PluginInfos &plgInfos) {
+    if (settings["Author"])
+        plgInfos.author = settings["Author"].as<string>();
+
+    if (settings["Title"])
+        plgInfos.title = settings["Title"].as<string>();
+
+    if (settings["Summary"])
+        plgInfos.summary = settings["Summary"].as<string>();
+
+    if (settings["Description"])
+        plgInfos.description = settings["Description"].as<string>();
+}
+
+static _3gx_Infos::Compatibility GetCompatibility(YAML::Node &settings, ostream &log) {
+    if (settings["Compatibility"]) {
+        string value = settings["Compatibility"].as<string>();
+        transform(value.begin(), value.end(), value.begin(),
+            [](unsigned char c){ return tolower(c);});
+
+        if (value == "console")
+            return _3gx_Infos::Compatibility::CONSOLE;
+
+        else if (value == "citra")
+            return _3gx_Infos::Compatibility::CITRA;
+
+        else if (value == "any")
+            return _3gx_Infos::Compatibility::CONSOLE_CITRA;
+
+        log << "Invalid compatibility entry in the plugin info file." \
+        "Please set the \"Compatibility\" configuration. (Possible values: \"Console\", \"Citra\", \"Any\")." \
+        "Assuming compatibility mode: \"Any\"" << endl;
+        return _3gx_Infos::Compatibility::CONSOLE_CITRA;
+    }
+
+    else {
+        log << "Missing compatibility entry in the plugin info file. " \
+        "Please set the \"Compatibility\" configuration. (Possible values: \"Console\", \"Citra\", \"Any\"). " \
+        "Assuming compatibility mode: \"Any\"" << endl;
+        return _3gx_Infos::Compatibility::CONSOLE_CITRA;
+    }
+}
+
+static _3gx_Infos::MemorySize GetMemorySize(YAML::Node &settings, ostream &log) {
+    if (settings["MemorySize"]) {
+        string value = settings["MemorySize"].as<string>();
+        transform(value.begin(), value.end(), value.begin(),
+            [](unsigned char c){ return tolower(c);});
+
+        if (value == "2mib")
+            return _3gx_Infos::MemorySize::_2MiB;
+
+        else if (value == "5mib")
+            return _3gx_Infos::MemorySize::_5MiB;
+
+        else if (value == "10mib")
+            return _3gx_Infos::MemorySize::_10MiB;
+
+        log << "Invalid memory size entry in the plugin info file." \
+        "Please set the \"MemorySize\" configuration. (Possible values: \"2MiB\", \"5MiB\", \"10MiB\")." \
+        "Assuming memory size: \"5MiB\"" << endl;
+        return _3gx_Infos::MemorySize::_5MiB;
+    }
+
+    else {
+        log << "Missing memory size entry in the plugin info file." \
+        "Please set the \"MemorySize\" configuration. (Possible values: \"2MiB\", \"5MiB\", \"10MiB\")." \
+        "Assuming memory size: \"5MiB\"" << endl;
+        return _3gx_Infos::MemorySize::_5MiB;
+    }
+}
+
+static bool GetEventsSelfManaged(YAML::Node &settings) {
+    if (settings["EventsSelfManaged"]) {
+        string value = settings["EventsSelfManaged"].as<string>();
+        transform(value.begin(), value.end(), value.begin(),
+            [](unsigned char c){ return tolower(c);});
+
+        return value == "true";
+    }
+
+    return false;
+}
+
+static bool GetSwapNotNeeded(YAML::Node &settings) {
+    if (settings["SwapNotNeeded"]) {
+        string value = settings["SwapNotNeeded"].as<string>();
+        transform(value.begin(), value.end(), value.begin(),
+            [](unsigned char c){ return tolower(c);});
+
+        return value == "true";
+    }
+
+    return false;
+}
+
+static void GetTitles(YAML::Node &settings, PluginInfos &plgInfos) {
+    if (settings["Targets"]) {
+        auto list =  settings["Targets"];
+
+        if (list.size() >= 1 && list[0].as<u32>() != 0) {
+            for (u32 i = 0; i < list.size(); ++i)
+                plgInfos.targets.push_back(list[i].as<u32>());
+        }
+    }
+}
+
+PluginSettings ParseSettings(istream &settingsFile) {
+    PluginSettings parsed;
+    YAML::Node settings;
+    ostringstream warnings;
+    _3gx_Infos infos;
+
+    // Parse yaml
+    settings = YAML::Load(settingsFile);
+
+    // Fetch version
+    parsed.version = GetVersion(settings);
+
+    // Fetch Infos
+    GetInfos(settings, parsed.infos);
+
+    // Fetch titles
+    GetTitles(settings, parsed.infos);
+
+    // Fetch compatibility and memory size
+    infos.compatibility = static_cast<u32>(GetCompatibility(settings, warnings));
+    infos.memoryRegionSize = static_cast<u32>(GetMemorySize(settings, warnings));
+    infos.eventsSelfManaged = static_cast<u32>(GetEventsSelfManaged(settings));
+    infos.swapNotNeeded = static_cast<u32>(GetSwapNotNeeded(settings));
+    parsed.flags = infos.flags;
+    parsed.warnings = warnings.str();
+    return parsed;
+}
+
+PluginSettings LoadSettingsFile(const string &settingsPath) {
+    ifstream settingsFile;
+
+    // Open files
+    settingsFile.open(settingsPath, ios::in);
+
+    if (!settingsFile.is_open())
+        throw runtime_error("couldn't open: " + settingsPath);
+
+    return ParseSettings(settingsFile);
+}
+
+ConvertContext::ConvertContext(const ConvertOptions &options, shared_ptr<const PluginSettings> settings, shared_ptr<const EncLib> encLib)
+    : _options(options), _settings(move(settings)), _encLib(move(encLib)) {
+    _header.version = _settings->version;
+    _header.infos.flags = _settings->flags;
+}
+
+void ConvertContext::LoadElf(const string &elfPath, ostream &log) {
+    _elf.reset(new ElfConvert(elfPath, log));
+}
+
+void ConvertContext::LoadElf(const void *elfData, size_t elfSize, ostream &log) {
+    _elf.reset(new ElfConvert(elfData, elfSize, log));
+}
+
+void ConvertContext::HashInputs(Hasher &hasher) const {
+    const PluginInfos &plgInfos = _settings->infos;
+    u64 encLibHash = _encLib ? _encLib->GetHash() : 0;
+
+    if (!_elf)
+        die("No ELF to convert!");
+
+    _elf->HashContents(hasher);
+
+    // Settings
+    hasher.UpdateWord(_settings->version);
+    hasher.UpdateWord(_settings->flags);
+    hasher.UpdateString(plgInfos.author);
+    hasher.UpdateString(plgInfos.title);
+    hasher.UpdateString(plgInfos.summary);
+    hasher.UpdateString(plgInfos.description);
+    hasher.UpdateWord(plgInfos.targets.size());
+    hasher.Update(plgInfos.targets.data(), plgInfos.targets.size() * sizeof(u32));
+
+    // Encryption library, 0 for the default payloads
+    hasher.Update(&encLibHash, sizeof(encLibHash));
+
+    // Options changing the output
+    hasher.UpdateWord(_options.writeSymbols);
+    hasher.UpdateWord(_options.writeNameIndex);
+    hasher.UpdateWord(_options.writeAddrIndex);
+    hasher.UpdateWord(_options.compress);
+    hasher.UpdateWord(_options.trimData);
+    hasher.UpdateWord(_options.alignment);
+}
+
+// Whether the file uses a field which only exists in the header extension
+static bool NeedsHeaderExtension(const ConvertOptions &options) {
+    return (options.writeSymbols && (options.writeNameIndex || options.writeAddrIndex)) || options.compress || options.alignment;
+}
+
+const FileImage &ConvertContext::Convert(void) {
+    const PluginInfos &plgInfos = _settings->infos;
+    _3gx_Header &header = _header;
+    FileImage &image = _image;
+
+    if (!_elf)
+        die("No ELF to convert!");
+
+    if (_converted)
+        return _image;
+
+    // The header is only written out once the whole layout is known
+    image.Append(&header, sizeof(_3gx_Header));
+
+    if (NeedsHeaderExtension(_options)) {
+        header.extensionSize = sizeof(_3gx_HeaderExtension);
+        image.Append(&_headerExtension, sizeof(_3gx_HeaderExtension));
+    }
+
+    if (!plgInfos.title.empty()) {
+        header.infos.titleLen = plgInfos.title.size() + 1;
+        header.infos.titleMsg = image.Append(plgInfos.title.c_str(), header.infos.titleLen);
+    }
+
+    if (!plgInfos.author.empty()) {
+        header.infos.authorLen = plgInfos.author.size() + 1;
+        header.infos.authorMsg = image.Append(plgInfos.author.c_str(), header.infos.authorLen);
+    }
+
+    if (!plgInfos.summary.empty()) {
+        header.infos.summaryLen = plgInfos.summary.size() + 1;
+        header.infos.summaryMsg = image.Append(plgInfos.summary.c_str(), header.infos.summaryLen);
+    }
+
+    if (!plgInfos.description.empty()) {
+        header.infos.descriptionLen = plgInfos.description.size() + 1;
+        header.infos.descriptionMsg = image.Append(plgInfos.description.c_str(), header.infos.descriptionLen);
+    }
+
+    if (!plgInfos.targets.empty()) {
+        header.targets.count = plgInfos.targets.size();
+        header.targets.titles = image.Append(plgInfos.targets.data(), 4 * plgInfos.targets.size());
+    }
+
+    _elf->WriteToImage(header, _headerExtension, image, _options, _encLib.get());
+    _converted = true;
+    return _image;
+}
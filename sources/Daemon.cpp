@@ -0,0 +1,351 @@
+#include "Daemon.hpp"
+#include "Hash.hpp"
+#include "MappedFile.hpp"
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#endif
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
+#define die(msg) {throw runtime_error(msg);}
+
+// Sanity limits of a request
+#define MAX_ARGS (4096)
+#define MAX_ARG_SIZE (1u << 20)
+
+// First word of a request, "3GXD" followed by the protocol revision
+#define DAEMON_REQUEST_MAGIC (0x44584733)
+#define DAEMON_PROTOCOL_VERSION (1)
+
+// A client stalling mid-request is dropped after this long (seconds), it would block the others
+#define DAEMON_IO_TIMEOUT (10)
+
+// A response is a sequence of frames: u32 type, u32 size, data
+enum FrameType : u32 {
+    FRAME_EXIT = 0, // Data is the s32 exit code, ends the response
+    FRAME_STDOUT = 1,
+    FRAME_STDERR = 2,
+};
+
+#ifndef _WIN32
+
+static bool WriteAll(int fd, const void *data, size_t size) {
+    const char *bytes = static_cast<const char *>(data);
+
+    while (size) {
+        ssize_t written = write(fd, bytes, size);
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        bytes += written;
+        size -= written;
+    }
+
+    return true;
+}
+
+static bool ReadAll(int fd, void *data, size_t size) {
+    char *bytes = static_cast<char *>(data);
+
+    while (size) {
+        ssize_t rd = read(fd, bytes, size);
+
+        if (rd < 0 && errno == EINTR)
+            continue;
+
+        if (rd <= 0)
+            return false;
+
+        bytes += rd;
+        size -= rd;
+    }
+
+    return true;
+}
+
+static bool WriteWord(int fd, u32 value) {
+    value = le_word(value);
+    return WriteAll(fd, &value, sizeof(value));
+}
+
+static bool ReadWord(int fd, u32 &value) {
+    if (!ReadAll(fd, &value, sizeof(value)))
+        return false;
+
+    value = le_word(value);
+    return true;
+}
+
+static bool WriteString(int fd, const string &value) {
+    return WriteWord(fd, value.size()) && WriteAll(fd, value.data(), value.size());
+}
+
+static bool ReadString(int fd, string &value) {
+    u32 size;
+
+    if (!ReadWord(fd, size) || size > MAX_ARG_SIZE)
+        return false;
+
+    value.resize(size);
+    return ReadAll(fd, &value[0], size);
+}
+
+static bool WriteFrame(int fd, u32 type, const string &data) {
+    return WriteWord(fd, type) && WriteString(fd, data);
+}
+
+// The version string doesn't change with every build, the executable does
+static string GetBuildId(void) {
+    char path[4096];
+
+#ifdef __APPLE__
+    u32 size = sizeof(path);
+
+    if (_NSGetExecutablePath(path, &size) != 0)
+        return string();
+#else
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+
+    if (length <= 0)
+        return string();
+
+    path[length] = '\0';
+#endif
+
+    try {
+        MappedFile executable(path);
+        Hasher hasher;
+        char id[17];
+
+        hasher.Update(executable.Data(), executable.Size());
+        snprintf(id, sizeof(id), "%016llx", static_cast<unsigned long long>(hasher.Digest()));
+        return id;
+    }
+
+    catch (exception &) {
+        return string();
+    }
+}
+
+static bool MakeAddress(const string &socketPath, struct sockaddr_un &address) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (socketPath.size() >= sizeof(address.sun_path))
+        return false;
+
+    memcpy(address.sun_path, socketPath.c_str(), socketPath.size());
+    return true;
+}
+
+static int Connect(const string &socketPath) {
+    struct sockaddr_un address;
+    int fd;
+
+    if (!MakeAddress(socketPath, address) || (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return -1;
+
+    if (connect(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// Request: u32 magic, u32 protocol version, the tool version and build, u32 count, the working directory
+// then the arguments, each string as u32 size + data. A refused request gets no response at all.
+static void ServeRequest(int fd, const string &version, const DaemonHandler &handler) {
+    vector<string> args;
+    string clientVersion, cwd;
+    u32 magic, protocol, count;
+
+    if (!ReadWord(fd, magic) || magic != DAEMON_REQUEST_MAGIC || !ReadWord(fd, protocol) || protocol != DAEMON_PROTOCOL_VERSION
+        || !ReadString(fd, clientVersion) || clientVersion != version)
+        return;
+
+    if (!ReadWord(fd, count) || !count || count > MAX_ARGS || !ReadString(fd, cwd))
+        return;
+
+    args.resize(count - 1);
+
+    for (string &arg : args) {
+        if (!ReadString(fd, arg))
+            return;
+    }
+
+    ostringstream out, err;
+    streambuf *coutBuffer = cout.rdbuf(out.rdbuf());
+    streambuf *cerrBuffer = cerr.rdbuf(err.rdbuf());
+    s32 exitCode = -1;
+
+    try {
+        if (chdir(cwd.c_str()) != 0)
+            die("Couldn't enter the directory: " + cwd);
+
+        exitCode = handler(args);
+    }
+
+    catch (exception &e) {
+        cerr << "An exception occured: " << e.what() << endl;
+    }
+
+    cout.rdbuf(coutBuffer);
+    cerr.rdbuf(cerrBuffer);
+
+    // The client may be gone, there's nothing to do about it
+    u32 exitWord = le_word(static_cast<u32>(exitCode));
+
+    if (WriteFrame(fd, FRAME_STDOUT, out.str()) && WriteFrame(fd, FRAME_STDERR, err.str()))
+        WriteFrame(fd, FRAME_EXIT, string(reinterpret_cast<const char *>(&exitWord), sizeof(exitWord)));
+}
+
+int RunDaemon(const string &socketPath, const string &version, const DaemonHandler &handler) {
+    struct sockaddr_un address;
+    struct stat st;
+    struct timeval timeout = {DAEMON_IO_TIMEOUT, 0};
+    string buildVersion = version + "+" + GetBuildId();
+    int probe = Connect(socketPath);
+
+    if (probe >= 0) {
+        close(probe);
+        die("A daemon is already listening on: " + socketPath);
+    }
+
+    if (!MakeAddress(socketPath, address))
+        die("The socket path is too long: " + socketPath);
+
+    // A client leaving early mustn't take the daemon down
+    signal(SIGPIPE, SIG_IGN);
+
+    // Left behind by a daemon which didn't exit cleanly, anything else is the user's file
+    if (lstat(socketPath.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode))
+            die("Not a socket, refusing to replace it: " + socketPath);
+
+        unlink(socketPath.c_str());
+    }
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (server < 0)
+        die("Couldn't create the socket!");
+
+    // Only the user may run conversions through the daemon
+    mode_t mask = umask(077);
+    int bound = bind(server, reinterpret_cast<struct sockaddr *>(&address), sizeof(address));
+
+    umask(mask);
+
+    if (bound != 0 || listen(server, 16) != 0) {
+        close(server);
+        die("Couldn't listen on: " + socketPath);
+    }
+
+    while (true) {
+        int client = accept(server, nullptr, nullptr);
+
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            close(server);
+            die("Couldn't accept a connection on: " + socketPath);
+        }
+
+        // Reads and writes then fail instead of blocking, and the request is dropped
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        ServeRequest(client, buildVersion, handler);
+        close(client);
+    }
+}
+
+bool ForwardToDaemon(const string &socketPath, const string &version, const vector<string> &args, int &exitCode) {
+    int fd = Connect(socketPath);
+    char cwd[4096];
+
+    if (fd < 0)
+        return false;
+
+    if (!getcwd(cwd, sizeof(cwd))) {
+        close(fd);
+        return false;
+    }
+
+    // A daemon refusing the request may close the connection while it's still being sent
+    void (*sigpipeHandler)(int) = signal(SIGPIPE, SIG_IGN);
+    bool sent = WriteWord(fd, DAEMON_REQUEST_MAGIC) && WriteWord(fd, DAEMON_PROTOCOL_VERSION) && WriteString(fd, version + "+" + GetBuildId())
+        && WriteWord(fd, args.size() + 1) && WriteString(fd, cwd);
+
+    for (size_t i = 0; sent && i < args.size(); ++i)
+        sent = WriteString(fd, args[i]);
+
+    signal(SIGPIPE, sigpipeHandler);
+
+    // The request is only run once complete, so it can still be run locally
+    if (!sent) {
+        close(fd);
+        return false;
+    }
+
+    u32 type;
+    string data;
+    bool responded = false;
+
+    while (ReadWord(fd, type) && ReadString(fd, data)) {
+        responded = true;
+
+        if (type == FRAME_STDOUT)
+            cout << data << flush;
+
+        else if (type == FRAME_STDERR)
+            cerr << data << flush;
+
+        else if (type == FRAME_EXIT && data.size() == sizeof(u32)) {
+            u32 exitWord;
+
+            memcpy(&exitWord, data.data(), sizeof(exitWord));
+            exitCode = static_cast<s32>(le_word(exitWord));
+            close(fd);
+            return true;
+        }
+    }
+
+    close(fd);
+
+    // Refused, by a daemon of another version, before anything was run
+    if (!responded)
+        return false;
+
+    cerr << "The daemon closed the connection before the end of the request!" << endl;
+    exitCode = -1;
+    return true;
+}
+
+#else
+
+int RunDaemon(const string &socketPath, const string &version, const DaemonHandler &handler) {
+    die("The daemon isn't supported on this platform!");
+}
+
+bool ForwardToDaemon(const string &socketPath, const string &version, const vector<string> &args, int &exitCode) {
+    return false;
+}
+
+#endif
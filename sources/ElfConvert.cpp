@@ -1,71 +1,112 @@
 #include "ElfConvert.hpp"
-#include <dynalo.hpp>
+#include "Checksum.hpp"
+#include "Lz.hpp"
+#include "SymbolTable.hpp"
+#include "Trace.hpp"
 #include <cstring>
 #include <iostream>
 #include <algorithm>
+#include <thread>
 
 #define die(msg) {throw runtime_error(msg);}
 #define safe_call(a) do {int rc = a; if(rc != 0) return rc;} while(0)
 
 using namespace std;
 
-extern string g_enclibpath;
 static const u8 defaultFunc[] = {0xC0, 0x40, 0x2D, 0xE9, 0x00, 0x70, 0xA0, 0xE3, 0x04, 0x60, 0x90, 0xE4, 0x06, 0x70, 0x87, 0xE0,
                                 0x01, 0x00, 0x50, 0xE1, 0xFB, 0xFF, 0xFF, 0x1A, 0x07, 0x00, 0xA0, 0xE1, 0xC0, 0x80, 0xBD, 0xE8,
                                 0x00, 0xF0, 0x20, 0xE3};
 
-static u32 defaultFuncExec(void *data, u32 sizeBytes, u32 params[4]) {
-    u32 ret = 0;
-    u32 *d = (u32*)data;
-    u32 *e = d + (sizeBytes / sizeof(u32));
-    while (d < e) ret += *d++;
-    return ret;
+// Whether the range lies within the file, the ELF being untrusted input
+static inline bool InFile(u32 offset, u32 size, size_t fileSize) {
+    return static_cast<u64>(offset) + size <= fileSize;
 }
 
-// Cannot be placed in the hpp file as dynalo can only be used on a single file
-dynalo::library *_encLib{nullptr};
+static u32 defaultFuncExec(const void *data, u32 sizeBytes, u32 params[4], u32 maxThreads) {
+    return ChecksumWords(data, sizeBytes, maxThreads);
+}
+
+// Compresses a segment unless it doesn't get any smaller. Returns the compressed size, 0 if it's stored as is
+static u32 CompressSegment(const char *segment, u32 size, vector<u8> &compressed) {
+    const u8 *data = reinterpret_cast<const u8 *>(segment);
+
+    compressed.clear();
 
-ElfConvert::ElfConvert(const string &elfPath) {
-    u32 fileSize;
-    Elf32_Ehdr *elfHdr;
-    Elf32_Phdr *pHdr;
-    ifstream ifile;
-    ifile.open(elfPath, ios::in | ios::binary);
+    if (!size)
+        return 0;
 
-    if (!ifile.is_open())
-        die("Couldn't open the file!");
+    compressed = LzCompress(data, size);
+
+    if (compressed.size() >= size) {
+        compressed.clear();
+        return 0;
+    }
 
-    // Get elf file size
-    ifile.seekg(0, ios::end);
-    fileSize = (u32)ifile.tellg();
-    ifile.seekg(0, ios::beg);
+    // Round trip through the reference decompressor, so a file the loader can't decode is never written
+    vector<u8> check(size);
 
-    // Read file
-    _img = new char[fileSize];
-    ifile.read(_img, fileSize);
-    ifile.close();
+    if (!LzDecompress(compressed.data(), compressed.size(), check.data(), size) || memcmp(check.data(), data, size))
+        die("The compressed segment doesn't decompress to the original one!");
+
+    return compressed.size();
+}
+
+ElfConvert::ElfConvert(const string &elfPath, ostream &log) : _file(elfPath) {
+    TraceSpan span("ElfConvert::ElfConvert");
+
+    _Load(log);
+}
+
+ElfConvert::ElfConvert(const void *elfData, size_t elfSize, ostream &log) : _file(elfData, elfSize) {
+    TraceSpan span("ElfConvert::ElfConvert");
+
+    _Load(log);
+}
+
+void ElfConvert::_Load(ostream &log) {
+    PhaseTimer timer(_stats, StatsPhase::ElfRead);
+    size_t fileSize = _file.Size();
+    const Elf32_Ehdr *elfHdr;
+    const Elf32_Phdr *pHdr;
+
+    // The image is only a view of the file, nothing is read until it's touched
+    _img = _file.Data();
+    _stats.bytesRead += fileSize;
 
     // Check file is ELF
-    elfHdr = reinterpret_cast<Elf32_Ehdr *>(_img);
+    elfHdr = reinterpret_cast<const Elf32_Ehdr *>(_img);
 
-    if (memcmp(elfHdr->e_ident, ELF_MAGIC, 4) != 0)
+    if (fileSize < sizeof(Elf32_Ehdr) || memcmp(elfHdr->e_ident, ELF_MAGIC, 4) != 0)
         die("Invalid ELF file!");
 
     if (le_hword(elfHdr->e_type) != ET_EXEC)
         die("ELF file must be executable! (hdr->e_type should be ET_EXEC)");
 
-    _elfSects = reinterpret_cast<Elf32_Shdr *>(_img + le_word(elfHdr->e_shoff));
+    if (le_word(elfHdr->e_shoff) + (u64)le_hword(elfHdr->e_shnum) * sizeof(Elf32_Shdr) > fileSize
+        || le_word(elfHdr->e_phoff) + (u64)le_hword(elfHdr->e_phnum) * sizeof(Elf32_Phdr) > fileSize)
+        die("Truncated ELF file!");
+
+    _elfSects = reinterpret_cast<const Elf32_Shdr *>(_img + le_word(elfHdr->e_shoff));
     _elfSectCount = static_cast<int>(le_hword(elfHdr->e_shnum));
-    _elfSectNames = reinterpret_cast<const char *>(_img + le_word(_elfSects[le_hword(elfHdr->e_shstrndx)].sh_offset));
 
-    pHdr = reinterpret_cast<Elf32_Phdr *>(_img + le_word(elfHdr->e_phoff));
+    if (le_hword(elfHdr->e_shstrndx) >= _elfSectCount)
+        die("Invalid section names index!");
+
+    const Elf32_Shdr *namesSect = _elfSects + le_hword(elfHdr->e_shstrndx);
+
+    if (!InFile(le_word(namesSect->sh_offset), le_word(namesSect->sh_size), fileSize))
+        die("Truncated ELF file!");
+
+    _elfSectNames = reinterpret_cast<const char *>(_img + le_word(namesSect->sh_offset));
+
+    pHdr = reinterpret_cast<const Elf32_Phdr *>(_img + le_word(elfHdr->e_phoff));
     _baseAddr = 1, _topAddr = 0;
 
     if (le_hword(elfHdr->e_phnum) > 3)
         die("Too many segments!");
 
     for (u32 i = 0; i < le_hword(elfHdr->e_phnum); ++i) {
-        Elf32_Phdr *cur = pHdr + i;
+        const Elf32_Phdr *cur = pHdr + i;
         SegConv s;
 
         s.fileOff = le_word(cur->p_offset);
@@ -97,6 +138,11 @@ ElfConvert::ElfConvert(const string &elfPath) {
         if (s.fileSize & 3)
             die("The loadable part of the segment is not word-aligned!");
 
+        if ((u64)s.fileOff + s.fileSize > fileSize)
+            die("The segment is out of the file bounds!");
+
+        _file.WillNeed(s.fileOff, s.fileSize);
+
         switch (s.flags) {
             case 5: // Code
                 if (_codeSeg)
@@ -137,58 +183,101 @@ ElfConvert::ElfConvert(const string &elfPath) {
     }
 
     if ((_topAddr - _baseAddr) >= 0x200000)
-        cout << "WARNING: The executable is bigger than 2 MiB! Only 3 MiB are left for heap memory, plugin may be unstable!" << endl;
+        log << "WARNING: The executable is bigger than 2 MiB! Only 3 MiB are left for heap memory, plugin may be unstable!" << endl;
 
     if (le_word(elfHdr->e_entry) != _baseAddr)
         die("Entrypoint should be zero!");
 
-    _GetSymbols();
+    // The symbols themselves are only processed if they are written
+    _FindSymbolTable();
 }
 
 ElfConvert::~ElfConvert(void) {
-    if (_img)
-        delete[] _img;
-
     if (_binaryBuff)
         delete[] _binaryBuff;
+}
 
-    if (_encLib) {
-        delete _encLib;
-        _encLib = nullptr;
+void ElfConvert::HashContents(Hasher &hasher) const {
+    const Elf32_Shdr *strSect = _elfSects + le_word(_elfSymSect->sh_link);
+    const Elf32_Shdr *sections[] = {_elfSymSect, strSect};
+
+    hasher.UpdateWord(_baseAddr);
+    hasher.UpdateWord(_codeSegSize);
+    hasher.UpdateWord(_rodataSegSize);
+    hasher.UpdateWord(_dataSegSize);
+    hasher.UpdateWord(_bssSize);
+    hasher.Update(_codeSeg, _codeSegSize);
+    hasher.Update(_rodataSeg, _rodataSegSize);
+    hasher.Update(_dataSeg, _dataSegSize);
+
+    // Both were checked against the file size by _FindSymbolTable
+    for (const Elf32_Shdr *sect : sections) {
+        u32 offset = le_word(sect->sh_offset), size = le_word(sect->sh_size);
+
+        _file.WillNeed(offset, size);
+        hasher.UpdateWord(size);
+        hasher.Update(_img + offset, size);
     }
 }
 
-void ElfConvert::WriteToFile(_3gx_Header &header, ofstream &outFile, bool writeSymbols) {
+void ElfConvert::_TrimData(void) {
+    u32 size = _dataSegSize;
+    u32 word;
+
+    // The loader clears the bss, a trailing run of zero words doesn't need to be stored
+    while (size >= sizeof(u32)) {
+        memcpy(&word, _dataSeg + size - sizeof(u32), sizeof(u32));
+
+        if (word)
+            break;
+
+        size -= sizeof(u32);
+    }
+
+    _trimmedDataSize += _dataSegSize - size;
+    _bssSize += _dataSegSize - size;
+    _dataSegSize = size;
+}
+
+void ElfConvert::WriteToImage(_3gx_Header &header, _3gx_HeaderExtension &extension, FileImage &image, const ConvertOptions &options, const EncLib *encLib) {
     _3gx_Infos &infos = header.infos;
     _3gx_Executable &exec = header.executable;
     _3gx_Symtable &symb = header.symtable;
 
+    // Must happen before the checksum, which only covers what's stored in the file
+    if (options.trimData)
+        _TrimData();
+
     // Update header infos
     exec.codeSize = _codeSegSize;
     exec.rodataSize = _rodataSegSize;
     exec.dataSize = _dataSegSize;
     exec.bssSize = _bssSize;
 
-    if (!g_enclibpath.empty())
-        _encLib = new dynalo::library(g_enclibpath);
-
-    // I could use _img directly, but I prefer not messing up something that I didn't make nor understand :P
-    _binaryBuff = new uint8_t[_codeSegSize + _rodataSegSize + _dataSegSize];
-    memcpy(_binaryBuff, _codeSeg, _codeSegSize);
-    memcpy(_binaryBuff + _codeSegSize, _rodataSeg, _rodataSegSize);
-    memcpy(_binaryBuff + _codeSegSize + _rodataSegSize, _dataSeg, _dataSegSize);
+    // The segments are written straight from the ELF image unless the enclib has to modify them
+    const char *codeSeg = _codeSeg;
+    const char *rodataSeg = _rodataSeg;
+    const char *dataSeg = _dataSeg;
 
     u32 exeparams[4] = {0}, swapparams[4] = {0};
     u32 decExePayload[32] = {0}, decSwapPayload[32] = {0}, encSwapPayload[32] = {0};
 
-    if (_encLib) { // Load the encrypt/decript lib
-        auto encfunc = _encLib->get_function<uint32_t(void*, uint32_t, uint32_t[4])>("encrypt");
-        auto embeddedDecFunc = _encLib->get_function<bool(uint32_t[32], uint32_t[4])>("decryptPayload");
-        auto embeddedSwapEncDecFunc = _encLib->get_function<bool(uint32_t[32], uint32_t[32], uint32_t[4])>("encryptDecryptSwapPayload");
-
-        infos.embeddedExeDecryptFunc = embeddedDecFunc(decExePayload, exeparams);
-        infos.exeDecChecksum = encfunc(_binaryBuff, _codeSegSize + _rodataSegSize + _dataSegSize, exeparams);
-        infos.embeddedSwapEncDecFunc = embeddedSwapEncDecFunc(encSwapPayload, decSwapPayload, swapparams);
+    // Ends with the checksum
+    PhaseTimer timer(_stats, StatsPhase::Encrypt);
+
+    if (encLib) {
+        // encrypt works in place on a contiguous executable
+        _binaryBuff = new uint8_t[_codeSegSize + _rodataSegSize + _dataSegSize];
+        memcpy(_binaryBuff, _codeSeg, _codeSegSize);
+        memcpy(_binaryBuff + _codeSegSize, _rodataSeg, _rodataSegSize);
+        memcpy(_binaryBuff + _codeSegSize + _rodataSegSize, _dataSeg, _dataSegSize);
+        codeSeg = reinterpret_cast<const char *>(_binaryBuff);
+        rodataSeg = codeSeg + _codeSegSize;
+        dataSeg = rodataSeg + _rodataSegSize;
+
+        infos.embeddedExeDecryptFunc = encLib->GetDecryptPayload(decExePayload, exeparams);
+        infos.exeDecChecksum = encLib->Encrypt(_binaryBuff, _codeSegSize + _rodataSegSize + _dataSegSize, exeparams);
+        infos.embeddedSwapEncDecFunc = encLib->GetSwapPayloads(encSwapPayload, decSwapPayload, swapparams);
     }
 
     else { // Use the default lib to get the checksum
@@ -196,12 +285,16 @@ void ElfConvert::WriteToFile(_3gx_Header &header, ofstream &outFile, bool writeS
         memcpy(decSwapPayload, defaultFunc, sizeof(defaultFunc));
         memcpy(encSwapPayload, defaultFunc, sizeof(defaultFunc));
         infos.embeddedExeDecryptFunc = infos.embeddedSwapEncDecFunc = 1;
-        infos.exeDecChecksum = defaultFuncExec(_binaryBuff, _codeSegSize + _rodataSegSize + _dataSegSize, exeparams);
+        // The sum is made of whole words, so it can be done segment by segment
+        infos.exeDecChecksum = defaultFuncExec(_codeSeg, _codeSegSize, exeparams, options.maxThreads)
+                             + defaultFuncExec(_rodataSeg, _rodataSegSize, exeparams, options.maxThreads)
+                             + defaultFuncExec(_dataSeg, _dataSegSize, exeparams, options.maxThreads);
     }
 
+    timer.Next(StatsPhase::SegmentWrite);
+
     if (infos.embeddedExeDecryptFunc) {
         memcpy(infos.builtInDecExeArgs, exeparams, sizeof(infos.builtInDecExeArgs));
-        exec.exeDecOffset = static_cast<u32>(outFile.tellp());
         u32 payloadSize = 1;
 
         for (; payloadSize <= (sizeof(decExePayload) / sizeof(u32)); payloadSize++) {
@@ -212,13 +305,11 @@ void ElfConvert::WriteToFile(_3gx_Header &header, ofstream &outFile, bool writeS
         if (payloadSize > (sizeof(decExePayload) / sizeof(u32)))
             die("Decryption payload is too long or not \"NOP\" terminated.");
 
-        outFile.write((char*)decExePayload, payloadSize * sizeof(u32));
-        outFile.flush();
+        exec.exeDecOffset = image.AppendCopy(decExePayload, payloadSize * sizeof(u32));
     }
 
     if (infos.embeddedSwapEncDecFunc) {
         memcpy(infos.builtInSwapEncDecArgs, swapparams, sizeof(infos.builtInSwapEncDecArgs));
-        exec.swapEncOffset = static_cast<u32>(outFile.tellp());
         u32 payloadSize = 1;
 
         for (; payloadSize <= (sizeof(encSwapPayload) / sizeof(u32)); payloadSize++) {
@@ -229,9 +320,7 @@ void ElfConvert::WriteToFile(_3gx_Header &header, ofstream &outFile, bool writeS
         if (payloadSize > (sizeof(encSwapPayload) / sizeof(u32)))
             die("Swap ecryption payload is too long or not \"NOP\" terminated.");
 
-        outFile.write((char*)encSwapPayload, payloadSize*sizeof(u32));
-        outFile.flush();
-        exec.swapDecOffset = static_cast<u32>(outFile.tellp());
+        exec.swapEncOffset = image.AppendCopy(encSwapPayload, payloadSize * sizeof(u32));
         payloadSize = 1;
 
         for (; payloadSize <= (sizeof(decSwapPayload) / sizeof(u32)); payloadSize++) {
@@ -242,147 +331,416 @@ void ElfConvert::WriteToFile(_3gx_Header &header, ofstream &outFile, bool writeS
         if (payloadSize > (sizeof(decSwapPayload) / sizeof(u32)))
             die("Swap decryption payload is too long or not \"NOP\" terminated.");
 
-        outFile.write((char*)decSwapPayload, payloadSize*sizeof(u32));
-        outFile.flush();
+        exec.swapDecOffset = image.AppendCopy(decSwapPayload, payloadSize * sizeof(u32));
     }
 
-    // Write code to file
-    exec.codeOffset = static_cast<u32>(outFile.tellp()); { // Make the offset in file 16 bytes aligned
-        u32 padding = 16 - (exec.codeOffset & 0xF);
-        char zeroes[16] = {0};
-        outFile.write(zeroes, padding);
-        exec.codeOffset += padding;
+    // Make the offset in file 16 bytes aligned
+    if (!options.alignment)
+        image.AppendZeroes(16 - (image.Size() & 0xF));
+
+    extension.alignment = options.alignment;
+
+    if (options.compress) {
+        _3gx_Compression &comp = extension.compression;
+
+        header.magic = _3GX_MAGIC_COMPRESSED;
+        comp.codeCompressedSize = CompressSegment(codeSeg, _codeSegSize, _codeSegCompressed);
+        comp.rodataCompressedSize = CompressSegment(rodataSeg, _rodataSegSize, _rodataSegCompressed);
+        comp.dataCompressedSize = CompressSegment(dataSeg, _dataSegSize, _dataSegCompressed);
     }
 
-    outFile.write((char*)_binaryBuff, _codeSegSize);
-    outFile.flush();
+    // Code, rodata and data follow each other, unless each one starts on its own boundary
+    _AlignImage(image, options);
+
+    if (_codeSegCompressed.empty())
+        exec.codeOffset = image.Append(codeSeg, _codeSegSize);
+    else
+        exec.codeOffset = image.Append(_codeSegCompressed.data(), _codeSegCompressed.size());
 
-    // Write rodata to file
-    exec.rodataOffset = static_cast<u32>(outFile.tellp());
-    outFile.write((char*)_binaryBuff + _codeSegSize, _rodataSegSize);
-    outFile.flush();
+    _AlignImage(image, options);
 
-    // Write data to file
-    exec.dataOffset = static_cast<u32>(outFile.tellp());
-    outFile.write((char*)_binaryBuff + _codeSegSize + _rodataSegSize, _dataSegSize);
-    outFile.flush();
+    if (_rodataSegCompressed.empty())
+        exec.rodataOffset = image.Append(rodataSeg, _rodataSegSize);
+    else
+        exec.rodataOffset = image.Append(_rodataSegCompressed.data(), _rodataSegCompressed.size());
 
-    if (!writeSymbols) {
+    _AlignImage(image, options);
+
+    if (_dataSegCompressed.empty())
+        exec.dataOffset = image.Append(dataSeg, _dataSegSize);
+    else
+        exec.dataOffset = image.Append(_dataSegCompressed.data(), _dataSegCompressed.size());
+
+    if (!options.writeSymbols) {
         symb.nbSymbols = 0;
         symb.symbolsOffset = 0;
         symb.nameTableOffset = 0;
+        extension.nameIndexOffset = 0;
+        extension.addrIndexOffset = 0;
+        _AlignImage(image, options);
         return;
     }
 
-    // Write symbols to file
+    timer.Stop();
+    _GetSymbols(options.parallelSymbolsThreshold, options.maxThreads);
+    timer.Next(StatsPhase::SymbolWrite);
+
+    // The name table is already laid out, it is written as a single block
+    _AlignImage(image, options);
     symb.nbSymbols = _symbols.size();
-    symb.symbolsOffset = static_cast<u32>(outFile.tellp());
-    outFile.write(reinterpret_cast<char *>(_symbols.data()), sizeof(_3gx_Symbol) * _symbols.size());
-    outFile.flush();
+    symb.symbolsOffset = image.Append(_symbols.data(), sizeof(_3gx_Symbol) * _symbols.size());
+    symb.nameTableOffset = image.Append(_symbolsNames.data(), _symbolsNames.size());
 
-    // Write symbols name to file
-    symb.nameTableOffset = static_cast<u32>(outFile.tellp());
-    const char *name = _symbolsNames.data();
+    if (options.writeNameIndex) {
+        _nameIndex = BuildNameIndex(_symbolsNameHashes);
+        image.AppendZeroes((4 - (image.Size() & 3)) & 3);
+        extension.nameIndexOffset = image.Append(_nameIndex.data(), _nameIndex.size() * sizeof(u32));
+    }
 
-    for (const _3gx_Symbol &sym : _symbols)
-        outFile << string(name + le_word(sym.nameOffset)) << '\0';
+    if (options.writeAddrIndex) {
+        // Covers the whole executable, bss included
+        _addrIndex = BuildAddrIndex(_symbols, _baseAddr, _topAddr);
+        image.AppendZeroes((4 - (image.Size() & 3)) & 3);
+        extension.addrIndexOffset = image.Append(_addrIndex.data(), _addrIndex.size() * sizeof(u32));
+    }
+
+    // So the last block can be read whole
+    _AlignImage(image, options);
+}
 
-    outFile.flush();
+void ElfConvert::_AlignImage(FileImage &image, const ConvertOptions &options) {
+    if (options.alignment)
+        image.Align(options.alignment);
 }
 
-void ElfConvert::_GetSymbols(void) {
+void ElfConvert::_FindSymbolTable(void) {
     for (u32 i = 0; i < _elfSectCount; ++i) {
-        Elf32_Shdr *sect = _elfSects + i;
-
-        switch (le_word(sect->sh_type)) {
-            case SHT_SYMTAB:
-                _elfSyms = reinterpret_cast<Elf32_Sym *>(_img + le_word(sect->sh_offset));
-                _elfSymCount = le_word(sect->sh_size) / sizeof(Elf32_Sym);
-                _elfSymNames = reinterpret_cast<const char *>(_img + le_word(_elfSects[le_word(sect->sh_link)].sh_offset));
-
-                Elf32_Sym *sym = _elfSyms;
-                vector<Elf32_Sym *> symbols;
-
-                for (u32 i = 0; i < _elfSymCount; ++i, ++sym) {
-                    // Skip FILE symbols
-                    if (ELF32_ST_TYPE(sym->st_info) == STT_FILE)
-                        continue;
-
-                    // Skip SECTION symbols
-                    if (ELF32_ST_TYPE(sym->st_info) == STT_SECTION)
-                        continue;
-
-                    symbols.push_back(sym);
-                }
-
-                // Sort symbols by VA
-                sort(symbols.begin(), symbols.end(), [this](Elf32_Sym *left, Elf32_Sym *right) {
-                    // Make sure for the descriptor to be before the actual symbol
-                    // eg: $a then _myFunc
-                    return le_word(left->st_value) < le_word(right->st_value);
-                });
-
-                // Ensure there's no duplicate (should probably not be necessary, but just in case and it doesn't take that much execution time)
-                symbols.erase(unique(symbols.begin(), symbols.end(), [this](Elf32_Sym *left, Elf32_Sym *right) {
-                    return left->st_value == right->st_value
-                        && left->st_size == right->st_size
-                        && left->st_info == right->st_info
-                        && left->st_other == right->st_other
-                        && !strcmp(_elfSymNames + le_word(left->st_name), _elfSymNames + le_word(right->st_name));
-                }), symbols.end());
-
-                // Convert symbols to 3GX symbol types
-                u32 type = 0;
-                u32 lastAddr = 0;
-
-                for (auto it = symbols.begin(); it != symbols.end();) {
-                    Elf32_Sym *symbol = *it++;
-                    const char *name = _elfSymNames + le_word(symbol->st_name);
-
-                    if (name[0] == '$' && name[2] == '\0') {
-                        // Skip specifier when it's not relevant
-                        if (le_word(symbol->st_value) != le_word((*it)->st_value))
-                            continue;
-
-                        switch (name[1]) {
-                            case 'a': ///< label a list of instructions
-                            case 'p': ///< label
-                                type = _3GX_SYM__FUNC;
-                                break;
-                            case 'b': ///< label a bl Thumb
-                            case 't': ///< label a list of Thumb instructions
-                                type = _3GX_SYM__FUNC | _3GX_SYM__THUMB;
-                                break;
-                            case 'd':
-                                type = _3GX_SYM__DATA;
-                                break;
-                        }
-
-                        continue;
-                    }
-
-                    _AddSymbol(symbol, type | (lastAddr == le_word(symbol->st_value) ? _3GX_SYM__ALTNAME : 0));
-                    lastAddr = le_word(symbol->st_value);
-                    type = 0;
-                }
+        const Elf32_Shdr *sect = _elfSects + i;
+
+        if (le_word(sect->sh_type) != SHT_SYMTAB)
+            continue;
+
+        if (le_word(sect->sh_link) >= static_cast<u32>(_elfSectCount))
+            die("Invalid symbol names section!");
+
+        const Elf32_Shdr *strSect = _elfSects + le_word(sect->sh_link);
+        u32 strOffset = le_word(strSect->sh_offset), strSize = le_word(strSect->sh_size);
+
+        if (!InFile(le_word(sect->sh_offset), le_word(sect->sh_size), _file.Size()) || !InFile(strOffset, strSize, _file.Size()))
+            die("Truncated ELF file!");
+
+        // Every name within the section is then terminated
+        if (!strSize || _img[strOffset + strSize - 1] != '\0')
+            die("Invalid symbol names section!");
+
+        _elfSymSect = sect;
+        _elfSyms = reinterpret_cast<const Elf32_Sym *>(_img + le_word(sect->sh_offset));
+        _elfSymCount = le_word(sect->sh_size) / sizeof(Elf32_Sym);
+        _elfSymNames = _img + strOffset;
+        _elfSymNamesSize = strSize;
+        return;
+    }
+
+    die("ELF has no symbol table!");
+}
+
+// Sort key of a symbol: address, then mapping symbols before the others, then index in the symtab
+#define SYMKEY_INDEX_MASK (0x7FFFFFFFull)
+#define SYMKEY_NOT_MAPPING (0x80000000ull)
+
+static inline bool IsMappingSymbol(const char *name) {
+    return name[0] == '$' && name[1] && name[2] == '\0';
+}
+
+void ElfConvert::_FilterSymbols(u32 first, u32 last, vector<u64> &keys) const {
+    const Elf32_Sym *sym = _elfSyms + first;
+
+    for (u32 i = first; i < last; ++i, ++sym) {
+        // Skip FILE symbols
+        if (ELF32_ST_TYPE(sym->st_info) == STT_FILE)
+            continue;
+
+        // Skip SECTION symbols
+        if (ELF32_ST_TYPE(sym->st_info) == STT_SECTION)
+            continue;
+
+        // Make sure for the descriptor to be before the actual symbol
+        // eg: $a then _myFunc
+        u64 key = (static_cast<u64>(le_word(sym->st_value)) << 32) | i;
+
+        if (!IsMappingSymbol(_elfSymNames + le_word(sym->st_name)))
+            key |= SYMKEY_NOT_MAPPING;
 
+        keys.push_back(key);
+    }
+
+    sort(keys.begin(), keys.end());
+}
+
+vector<u64> ElfConvert::_GetSortedSymbolKeys(u32 parallelThreshold, u32 maxThreads) const {
+    u32 symCount = static_cast<u32>(_elfSymCount);
+    u32 threadCount = 1;
+    vector<u64> keys;
+
+    if (symCount > SYMKEY_INDEX_MASK)
+        die("Too many symbols!");
+
+    // Before the threads, which can't report it
+    for (u32 i = 0; i < symCount; ++i) {
+        if (le_word(_elfSyms[i].st_name) >= _elfSymNamesSize)
+            die("Invalid symbol name!");
+    }
+
+    if (parallelThreshold && symCount >= parallelThreshold)
+        threadCount = max(1u, min(maxThreads ? maxThreads : thread::hardware_concurrency(), symCount / 1024));
+
+    if (threadCount == 1) {
+        keys.reserve(symCount);
+        _FilterSymbols(0, symCount, keys);
+        return keys;
+    }
+
+    // Each thread filters and sorts its own slice of the symtab
+    vector<vector<u64>> slices(threadCount);
+    vector<thread> threads;
+    u32 sliceSize = (symCount + threadCount - 1) / threadCount;
+
+    for (u32 i = 0; i < threadCount; ++i) {
+        u32 first = min(symCount, i * sliceSize);
+        u32 last = min(symCount, first + sliceSize);
+
+        threads.emplace_back([this, &slices, i, first, last] {
+            slices[i].reserve(last - first);
+            _FilterSymbols(first, last, slices[i]);
+        });
+    }
+
+    for (thread &t : threads)
+        t.join();
+
+    // Then the sorted runs are merged pairwise, every merge of a round in its own thread
+    vector<size_t> bounds(1, 0);
+
+    for (const vector<u64> &slice : slices) {
+        keys.insert(keys.end(), slice.begin(), slice.end());
+        bounds.push_back(keys.size());
+    }
+
+    for (size_t width = 1; width < threadCount; width *= 2) {
+        threads.clear();
+
+        for (size_t i = 0; i + width < threadCount; i += 2 * width) {
+            auto first = keys.begin() + bounds[i];
+            auto middle = keys.begin() + bounds[i + width];
+            auto last = keys.begin() + bounds[min<size_t>(i + 2 * width, threadCount)];
+
+            threads.emplace_back([first, middle, last] {
+                inplace_merge(first, middle, last);
+            });
+        }
+
+        for (thread &t : threads)
+            t.join();
+    }
+
+    return keys;
+}
+
+static inline u32 MixHash(u32 hash, u32 value) {
+    hash ^= value + 0x9E3779B9 + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+void ElfConvert::_RemoveDuplicateSymbols(vector<const Elf32_Sym *> &symbols, vector<u32> &nameHashes) const {
+    const u32 empty = 0xFFFFFFFF;
+    size_t capacity = 16;
+
+    nameHashes.resize(symbols.size());
+
+    for (size_t i = 0; i < symbols.size(); ++i)
+        nameHashes[i] = _3gx_NameHash(_elfSymNames + le_word(symbols[i]->st_name));
+
+    while (capacity < symbols.size() * 2)
+        capacity <<= 1;
+
+    // Open addressing table of the symbols kept so far, the first occurrence is the one kept
+    vector<u32> table(capacity, empty);
+    size_t mask = capacity - 1;
+    size_t kept = 0;
+
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        const Elf32_Sym *sym = symbols[i];
+        u32 hash = nameHashes[i];
+        bool duplicate = false;
+
+        hash = MixHash(hash, le_word(sym->st_value));
+        hash = MixHash(hash, le_word(sym->st_size));
+        hash = MixHash(hash, (sym->st_info << 8) | sym->st_other);
+
+        size_t slot = hash & mask;
+
+        for (; table[slot] != empty; slot = (slot + 1) & mask) {
+            const Elf32_Sym *other = symbols[table[slot]];
+
+            if (nameHashes[table[slot]] == nameHashes[i]
+                && other->st_value == sym->st_value
+                && other->st_size == sym->st_size
+                && other->st_info == sym->st_info
+                && other->st_other == sym->st_other
+                && !strcmp(_elfSymNames + le_word(other->st_name), _elfSymNames + le_word(sym->st_name))) {
+                duplicate = true;
                 break;
+            }
         }
+
+        if (duplicate)
+            continue;
+
+        // Compact in place, the table refers to the kept position
+        symbols[kept] = sym;
+        nameHashes[kept] = nameHashes[i];
+        table[slot] = static_cast<u32>(kept++);
     }
 
-    if (!_elfSyms)
-        die("ELF has no symbol table!");
+    symbols.resize(kept);
+    nameHashes.resize(kept);
 }
 
-void ElfConvert::_AddSymbol(Elf32_Sym *symbol, u16 flags) {
+// Orders names on their reversed text, a name coming after the longer names it is a suffix of
+static bool NameSuffixLess(const char *left, u32 leftLength, const char *right, u32 rightLength) {
+    const char *l = left + leftLength;
+    const char *r = right + rightLength;
+
+    while (l != left && r != right) {
+        u8 a = *--l, b = *--r;
+
+        if (a != b)
+            return a < b;
+    }
+
+    return leftLength > rightLength;
+}
+
+void ElfConvert::_GetSymbols(u32 parallelThreshold, u32 maxThreads) {
+    TraceSpan span("ElfConvert::_GetSymbols");
+    PhaseTimer timer(_stats, StatsPhase::GetSymbols);
+    const Elf32_Shdr *strSect = _elfSects + le_word(_elfSymSect->sh_link);
+
+    // Only the symbols and their names are needed out of the non loadable sections
+    _file.WillNeed(le_word(_elfSymSect->sh_offset), le_word(_elfSymSect->sh_size));
+    _file.WillNeed(le_word(strSect->sh_offset), le_word(strSect->sh_size));
+
+    // Sort symbols by VA, through compact (address, index) keys rather than the symbols themselves
+    vector<u64> keys = _GetSortedSymbolKeys(parallelThreshold, maxThreads);
+    _stats.elfSymbols += _elfSymCount;
+    _stats.filteredSymbols += keys.size();
+    vector<const Elf32_Sym *> symbols(keys.size());
+
+    for (size_t i = 0; i < keys.size(); ++i)
+        symbols[i] = _elfSyms + static_cast<u32>(keys[i] & SYMKEY_INDEX_MASK);
+
+    // Ensure there's no duplicate, even when other symbols of the same address sit in between
+    vector<u32> nameHashes;
+
+    _RemoveDuplicateSymbols(symbols, nameHashes);
+    _stats.uniqueSymbols += symbols.size();
+
+    // Convert symbols to 3GX symbol types. The first pass picks the symbols and their flags,
+    // then the name table is planned, so the tables are only filled once exactly sized.
+    const u16 skipped = 0xFFFF;
+    vector<u16> flags(symbols.size(), skipped);
+    vector<u32> nameLengths(symbols.size(), 0);
+    vector<u32> named;
+    u32 type = 0;
+    u32 lastAddr = 0;
+
+    named.reserve(symbols.size());
+
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        const Elf32_Sym *symbol = symbols[i];
+        const char *name = _elfSymNames + le_word(symbol->st_name);
+
+        if (IsMappingSymbol(name)) {
+            // Skip specifier when it's not relevant
+            if (i + 1 == symbols.size() || le_word(symbol->st_value) != le_word(symbols[i + 1]->st_value))
+                continue;
+
+            switch (name[1]) {
+                case 'a': ///< label a list of instructions
+                case 'p': ///< label
+                    type = _3GX_SYM__FUNC;
+                    break;
+                case 'b': ///< label a bl Thumb
+                case 't': ///< label a list of Thumb instructions
+                    type = _3GX_SYM__FUNC | _3GX_SYM__THUMB;
+                    break;
+                case 'd':
+                    type = _3GX_SYM__DATA;
+                    break;
+            }
+
+            continue;
+        }
+
+        flags[i] = type | (lastAddr == le_word(symbol->st_value) ? _3GX_SYM__ALTNAME : 0);
+        nameLengths[i] = strlen(name);
+        named.push_back(static_cast<u32>(i));
+        lastAddr = le_word(symbol->st_value);
+        type = 0;
+    }
+
+    // Tail merging: sorted on their reversed text, identical names are adjacent and a name
+    // comes right after the longer names it ends, so it can point into the previous stored name
+    vector<u32> nameOffsets(symbols.size(), 0);
+    vector<u32> stored;
+    vector<u32> order(named);
+    u32 namesSize = 0;
+
+    sort(order.begin(), order.end(), [&](u32 left, u32 right) {
+        return NameSuffixLess(_elfSymNames + le_word(symbols[left]->st_name), nameLengths[left],
+                              _elfSymNames + le_word(symbols[right]->st_name), nameLengths[right]);
+    });
+
+    for (u32 i : order) {
+        const char *name = _elfSymNames + le_word(symbols[i]->st_name);
+
+        if (!stored.empty()) {
+            u32 prev = stored.back();
+            const char *prevName = _elfSymNames + le_word(symbols[prev]->st_name);
+
+            if (nameLengths[i] <= nameLengths[prev]
+                && !memcmp(prevName + nameLengths[prev] - nameLengths[i], name, nameLengths[i])) {
+                nameOffsets[i] = nameOffsets[prev] + nameLengths[prev] - nameLengths[i];
+                continue;
+            }
+        }
+
+        nameOffsets[i] = namesSize;
+        namesSize += nameLengths[i] + 1;
+        stored.push_back(i);
+    }
+
+    _symbolsNames.resize(namesSize);
+
+    for (u32 i : stored)
+        memcpy(_symbolsNames.data() + nameOffsets[i], _elfSymNames + le_word(symbols[i]->st_name), nameLengths[i] + 1);
+
+    _symbols.clear();
+    _symbols.reserve(named.size());
+    _symbolsNameHashes.clear();
+    _symbolsNameHashes.reserve(named.size());
+
+    for (u32 i : named) {
+        _AddSymbol(symbols[i], flags[i], nameOffsets[i]);
+        _symbolsNameHashes.push_back(nameHashes[i]);
+    }
+
+    _stats.writtenSymbols += _symbols.size();
+}
+
+void ElfConvert::_AddSymbol(const Elf32_Sym *symbol, u16 flags, u32 nameOffset) {
     _symbols.emplace_back(le_word(symbol->st_value),
                           le_word(symbol->st_size),
                           le_hword(flags),
-                          le_word(_symbolsNames.size()));
-
-    const char *name = _elfSymNames + le_word(symbol->st_name);
-
-    while (*name)
-        _symbolsNames.push_back(*name++);
-    _symbolsNames.push_back(0);
+                          le_word(nameOffset));
 }
\ No newline at end of file
@@ -0,0 +1,54 @@
+#include "EncLib.hpp"
+#include "Hash.hpp"
+#include "MappedFile.hpp"
+#include "Trace.hpp"
+#include <dynalo.hpp>
+#include <mutex>
+
+// Cannot be used anywhere else as dynalo can only be used on a single file
+typedef dynalo::library Library;
+
+// Libraries aren't expected to be reentrant, and the same library may be loaded by several
+// conversions, which share its state through the loader: every call is serialized.
+static mutex g_callLock;
+
+// The wait shows the contention between the conversions
+static unique_lock<mutex> LockCalls(void) {
+    TraceSpan span("EncLib lock wait");
+
+    return unique_lock<mutex>(g_callLock);
+}
+
+EncLib::EncLib(const string &path) : _path(path) {
+    MappedFile file(path);
+    Hasher hasher;
+
+    hasher.Update(file.Data(), file.Size());
+    _hash = hasher.Digest();
+    _library = new Library(path);
+}
+
+EncLib::~EncLib(void) {
+    delete static_cast<Library *>(_library);
+}
+
+u32 EncLib::Encrypt(void *executable, u32 size, u32 params[4]) const {
+    auto encrypt = static_cast<Library *>(_library)->get_function<uint32_t(void*, uint32_t, uint32_t[4])>("encrypt");
+    unique_lock<mutex> guard = LockCalls();
+
+    return encrypt(executable, size, params);
+}
+
+bool EncLib::GetDecryptPayload(u32 payload[32], u32 params[4]) const {
+    auto decryptPayload = static_cast<Library *>(_library)->get_function<bool(uint32_t[32], uint32_t[4])>("decryptPayload");
+    unique_lock<mutex> guard = LockCalls();
+
+    return decryptPayload(payload, params);
+}
+
+bool EncLib::GetSwapPayloads(u32 encPayload[32], u32 decPayload[32], u32 params[4]) const {
+    auto swapPayloads = static_cast<Library *>(_library)->get_function<bool(uint32_t[32], uint32_t[32], uint32_t[4])>("encryptDecryptSwapPayload");
+    unique_lock<mutex> guard = LockCalls();
+
+    return swapPayloads(encPayload, decPayload, params);
+}
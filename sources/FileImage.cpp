@@ -0,0 +1,215 @@
+#include "FileImage.hpp"
+#include "MappedFile.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <limits.h>
+#include <sys/uio.h>
+#endif
+
+#define die(msg) {throw runtime_error(msg);}
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+static const u8 g_zeroes[0x1000] = {0};
+static atomic<u32> g_tempCounter{0};
+
+u32 FileImage::Append(const void *data, u32 size) {
+    u32 offset = _size;
+
+    if (offset + static_cast<u64>(size) > 0xFFFFFFFF)
+        die("The output file is bigger than 4 GiB!");
+
+    if (size)
+        _chunks.push_back({static_cast<const u8 *>(data), size});
+
+    _size += size;
+    return offset;
+}
+
+u32 FileImage::AppendCopy(const void *data, u32 size) {
+    const u8 *bytes = static_cast<const u8 *>(data);
+
+    _storage.emplace_back(bytes, bytes + size);
+    return Append(_storage.back().data(), size);
+}
+
+u32 FileImage::AppendZeroes(u32 size) {
+    u32 offset = _size;
+
+    while (size) {
+        u32 count = min<u32>(size, sizeof(g_zeroes));
+
+        Append(g_zeroes, count);
+        size -= count;
+    }
+
+    return offset;
+}
+
+u32 FileImage::Align(u32 alignment) {
+    AppendZeroes((alignment - (_size & (alignment - 1))) & (alignment - 1));
+    return _size;
+}
+
+void FileImage::WriteToFile(const string &path) const {
+    TraceSpan span("FileImage::WriteToFile");
+
+#ifndef _WIN32
+    struct stat st;
+
+    // A file sharing its data through hard links (e.g. with a cache entry) is replaced, not overwritten
+    if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) && st.st_nlink > 1)
+        unlink(path.c_str());
+#endif
+
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+
+    if (fd < 0)
+        die("couldn't open: " + path);
+
+    try {
+        WriteToFd(fd);
+    }
+
+    catch (...) {
+        close(fd);
+        throw;
+    }
+
+    if (close(fd) != 0)
+        die("Couldn't write the file: " + path);
+}
+
+void FileImage::CopyTo(void *buffer) const {
+    u8 *dst = static_cast<u8 *>(buffer);
+
+    for (const Chunk &chunk : _chunks) {
+        memcpy(dst, chunk.data, chunk.size);
+        dst += chunk.size;
+    }
+}
+
+string FileImage::TempPath(const string &path) {
+    return path + ".tmp" + to_string(getpid()) + "." + to_string(g_tempCounter++);
+}
+
+bool FileImage::Matches(const string &path) const {
+    struct stat st;
+
+    // Most changes change the size, the contents are only read when it's the same
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode) || static_cast<u64>(st.st_size) != _size)
+        return false;
+
+    try {
+        MappedFile file(path);
+        const u8 *data = reinterpret_cast<const u8 *>(file.Data());
+
+        if (file.Size() != _size)
+            return false;
+
+        for (const Chunk &chunk : _chunks) {
+            if (memcmp(data, chunk.data, chunk.size) != 0)
+                return false;
+
+            data += chunk.size;
+        }
+    }
+
+    catch (exception &) {
+        return false;
+    }
+
+    return true;
+}
+
+bool FileImage::WriteToFileIfChanged(const string &path) const {
+    if (Matches(path))
+        return false;
+
+    string tempPath = TempPath(path);
+
+    try {
+        WriteToFile(tempPath);
+    }
+
+    catch (...) {
+        remove(tempPath.c_str());
+        throw;
+    }
+
+#ifdef _WIN32
+    remove(path.c_str());
+#endif
+
+    if (rename(tempPath.c_str(), path.c_str()) != 0) {
+        remove(tempPath.c_str());
+        die("Couldn't replace the file: " + path);
+    }
+
+    return true;
+}
+
+void FileImage::WriteToFd(int fd) const {
+#ifndef _WIN32
+    vector<struct iovec> iov(_chunks.size());
+
+    for (size_t i = 0; i < _chunks.size(); ++i) {
+        iov[i].iov_base = const_cast<u8 *>(_chunks[i].data);
+        iov[i].iov_len = _chunks[i].size;
+    }
+
+    // Usually done in a single call, only partial writes need to loop
+    size_t first = 0;
+
+    while (first < iov.size()) {
+        int count = static_cast<int>(min<size_t>(iov.size() - first, IOV_MAX));
+        ssize_t written = writev(fd, &iov[first], count);
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            die("Couldn't write the output file!");
+        }
+
+        size_t left = static_cast<size_t>(written);
+
+        while (first < iov.size() && left >= iov[first].iov_len)
+            left -= iov[first++].iov_len;
+
+        if (left) {
+            iov[first].iov_base = static_cast<u8 *>(iov[first].iov_base) + left;
+            iov[first].iov_len -= left;
+        }
+    }
+#else
+    for (const Chunk &chunk : _chunks) {
+        const u8 *data = chunk.data;
+        u32 size = chunk.size;
+
+        while (size) {
+            int written = write(fd, data, size);
+
+            if (written < 0)
+                die("Couldn't write the output file!");
+
+            data += written;
+            size -= written;
+        }
+    }
+#endif
+}
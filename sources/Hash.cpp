@@ -0,0 +1,130 @@
+#include "Hash.hpp"
+#include <cstring>
+
+static const u64 PRIME1 = 11400714785074694791ULL;
+static const u64 PRIME2 = 14029467366897019727ULL;
+static const u64 PRIME3 = 1609587929392839161ULL;
+static const u64 PRIME4 = 9650029242287828579ULL;
+static const u64 PRIME5 = 2870177450012600261ULL;
+
+static inline u64 Rotl(u64 value, u32 count) {
+    return (value << count) | (value >> (64 - count));
+}
+
+static inline u64 Read64(const u8 *data) {
+    u64 value;
+
+    memcpy(&value, data, sizeof(value));
+    return le_dword(value);
+}
+
+static inline u32 Read32(const u8 *data) {
+    u32 value;
+
+    memcpy(&value, data, sizeof(value));
+    return le_word(value);
+}
+
+static inline u64 Round(u64 acc, u64 input) {
+    acc += input * PRIME2;
+    return Rotl(acc, 31) * PRIME1;
+}
+
+static inline u64 Merge(u64 acc, u64 lane) {
+    acc ^= Round(0, lane);
+    return acc * PRIME1 + PRIME4;
+}
+
+Hasher::Hasher(u64 seed) : _seed(seed) {
+    _lanes[0] = seed + PRIME1 + PRIME2;
+    _lanes[1] = seed + PRIME2;
+    _lanes[2] = seed;
+    _lanes[3] = seed - PRIME1;
+}
+
+void Hasher::Update(const void *data, size_t size) {
+    const u8 *bytes = static_cast<const u8 *>(data);
+
+    if (!size)
+        return;
+
+    _totalSize += size;
+
+    // Complete the pending stripe first
+    if (_stripeSize) {
+        size_t count = sizeof(_stripe) - _stripeSize;
+
+        if (count > size)
+            count = size;
+
+        memcpy(_stripe + _stripeSize, bytes, count);
+        _stripeSize += count;
+        bytes += count;
+        size -= count;
+
+        if (_stripeSize < sizeof(_stripe))
+            return;
+
+        for (u32 i = 0; i < 4; ++i)
+            _lanes[i] = Round(_lanes[i], Read64(_stripe + i * 8));
+
+        _stripeSize = 0;
+    }
+
+    for (; size >= sizeof(_stripe); bytes += sizeof(_stripe), size -= sizeof(_stripe)) {
+        _lanes[0] = Round(_lanes[0], Read64(bytes));
+        _lanes[1] = Round(_lanes[1], Read64(bytes + 8));
+        _lanes[2] = Round(_lanes[2], Read64(bytes + 16));
+        _lanes[3] = Round(_lanes[3], Read64(bytes + 24));
+    }
+
+    memcpy(_stripe, bytes, size);
+    _stripeSize = size;
+}
+
+void Hasher::UpdateWord(u32 value) {
+    value = le_word(value);
+    Update(&value, sizeof(value));
+}
+
+void Hasher::UpdateString(const string &value) {
+    UpdateWord(value.size());
+    Update(value.data(), value.size());
+}
+
+u64 Hasher::Digest(void) const {
+    const u8 *tail = _stripe;
+    u32 size = _stripeSize;
+    u64 hash;
+
+    if (_totalSize >= sizeof(_stripe)) {
+        hash = Rotl(_lanes[0], 1) + Rotl(_lanes[1], 7) + Rotl(_lanes[2], 12) + Rotl(_lanes[3], 18);
+
+        for (u32 i = 0; i < 4; ++i)
+            hash = Merge(hash, _lanes[i]);
+    }
+
+    else
+        hash = _seed + PRIME5;
+
+    hash += _totalSize;
+
+    for (; size >= 8; tail += 8, size -= 8)
+        hash = Rotl(hash ^ Round(0, Read64(tail)), 27) * PRIME1 + PRIME4;
+
+    if (size >= 4) {
+        hash = Rotl(hash ^ (Read32(tail) * PRIME1), 23) * PRIME2 + PRIME3;
+        tail += 4;
+        size -= 4;
+    }
+
+    for (; size; ++tail, --size)
+        hash = Rotl(hash ^ (*tail * PRIME5), 11) * PRIME1;
+
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
@@ -0,0 +1,145 @@
+#include "Lz.hpp"
+#include <cstring>
+
+#define LZ_MIN_MATCH (4)
+#define LZ_MAX_OFFSET (0xFFFF)
+#define LZ_LAST_LITERALS (5) ///< The block always ends with that many literals
+#define LZ_MATCH_LIMIT (12) ///< No match may start that close to the end of the block
+#define LZ_HASH_BITS (16)
+
+static inline u32 Read32(const u8 *p) {
+    u32 value;
+
+    memcpy(&value, p, sizeof(u32));
+    return value;
+}
+
+static inline u32 Hash(u32 sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static void WriteLength(vector<u8> &out, size_t length) {
+    for (; length >= 255; length -= 255)
+        out.push_back(255);
+    out.push_back(static_cast<u8>(length));
+}
+
+static void WriteSequence(vector<u8> &out, const u8 *literals, size_t literalCount, u32 offset, size_t matchLength) {
+    size_t matchCode = matchLength ? matchLength - LZ_MIN_MATCH : 0;
+    u8 token = static_cast<u8>((literalCount >= 15 ? 15 : literalCount) << 4) | (matchCode >= 15 ? 15 : matchCode);
+
+    out.push_back(token);
+
+    if (literalCount >= 15)
+        WriteLength(out, literalCount - 15);
+
+    out.insert(out.end(), literals, literals + literalCount);
+
+    if (!matchLength)
+        return;
+
+    out.push_back(offset & 0xFF);
+    out.push_back(offset >> 8);
+
+    if (matchCode >= 15)
+        WriteLength(out, matchCode - 15);
+}
+
+vector<u8> LzCompress(const u8 *src, size_t srcSize) {
+    vector<u8> out;
+    vector<u32> table(1u << LZ_HASH_BITS, 0xFFFFFFFF);
+    size_t anchor = 0;
+    size_t pos = 0;
+
+    out.reserve(srcSize + srcSize / 255 + 16);
+
+    if (srcSize > LZ_MATCH_LIMIT) {
+        size_t matchLimit = srcSize - LZ_MATCH_LIMIT;
+        size_t copyLimit = srcSize - LZ_LAST_LITERALS;
+
+        while (pos < matchLimit) {
+            u32 sequence = Read32(src + pos);
+            u32 &slot = table[Hash(sequence)];
+            size_t candidate = slot;
+
+            slot = static_cast<u32>(pos);
+
+            if (candidate == 0xFFFFFFFF || pos - candidate > LZ_MAX_OFFSET || Read32(src + candidate) != sequence) {
+                ++pos;
+                continue;
+            }
+
+            size_t length = LZ_MIN_MATCH;
+
+            while (pos + length < copyLimit && src[candidate + length] == src[pos + length])
+                ++length;
+
+            WriteSequence(out, src + anchor, pos - anchor, static_cast<u32>(pos - candidate), length);
+            pos += length;
+            anchor = pos;
+        }
+    }
+
+    WriteSequence(out, src + anchor, srcSize - anchor, 0, 0);
+    return out;
+}
+
+static bool ReadLength(const u8 *&src, const u8 *end, size_t &length) {
+    u8 byte;
+
+    do {
+        if (src == end)
+            return false;
+
+        byte = *src++;
+        length += byte;
+    } while (byte == 255);
+
+    return true;
+}
+
+bool LzDecompress(const u8 *src, size_t srcSize, u8 *dst, size_t dstSize) {
+    const u8 *end = src + srcSize;
+    size_t pos = 0;
+
+    while (src < end) {
+        u8 token = *src++;
+        size_t literalCount = token >> 4;
+
+        if (literalCount == 15 && !ReadLength(src, end, literalCount))
+            return false;
+
+        if (literalCount > static_cast<size_t>(end - src) || literalCount > dstSize - pos)
+            return false;
+
+        memcpy(dst + pos, src, literalCount);
+        src += literalCount;
+        pos += literalCount;
+
+        // The last sequence has no match
+        if (src == end)
+            break;
+
+        if (end - src < 2)
+            return false;
+
+        size_t offset = src[0] | (src[1] << 8);
+        size_t length = (token & 0xF);
+
+        src += 2;
+
+        if (length == 15 && !ReadLength(src, end, length))
+            return false;
+
+        length += LZ_MIN_MATCH;
+
+        if (!offset || offset > pos || length > dstSize - pos)
+            return false;
+
+        // Byte by byte, the match may overlap what it produces
+        for (u8 *out = dst + pos, *in = out - offset; length--; ++pos)
+            *out++ = *in++;
+    }
+
+    return pos == dstSize;
+}
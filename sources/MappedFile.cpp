@@ -0,0 +1,107 @@
+#include "MappedFile.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#else
+#include <io.h>
+#endif
+
+#define die(msg) {throw runtime_error(msg);}
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+MappedFile::MappedFile(const string &path) {
+#ifdef _WIN32
+    if (path == "-")
+        _setmode(STDIN_FILENO, O_BINARY);
+#endif
+
+    // A duplicate, so stdin is closed like any other file
+    int fd = path == "-" ? dup(STDIN_FILENO) : open(path.c_str(), O_RDONLY | O_BINARY);
+    struct stat st;
+
+    if (fd < 0)
+        die("Couldn't open the file: " + path);
+
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        die("Couldn't stat the file: " + path);
+    }
+
+#ifndef _WIN32
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        _size = static_cast<size_t>(st.st_size);
+        _mapping = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (_mapping == MAP_FAILED)
+            _mapping = nullptr;
+
+        else {
+            // Most of a debug build is made of sections we never look at, don't read them ahead
+            madvise(_mapping, _size, MADV_RANDOM);
+            _data = static_cast<const char *>(_mapping);
+        }
+    }
+#endif
+
+    if (!_mapping)
+        _ReadBuffered(fd);
+
+    close(fd);
+}
+
+MappedFile::MappedFile(const void *data, size_t size) : _data(static_cast<const char *>(data)), _size(size) {
+}
+
+MappedFile::~MappedFile(void) {
+#ifndef _WIN32
+    if (_mapping)
+        munmap(_mapping, _size);
+#endif
+}
+
+void MappedFile::WillNeed(size_t offset, size_t size) const {
+#ifndef _WIN32
+    if (!_mapping || offset >= _size || !size)
+        return;
+
+    // madvise wants a page aligned address
+    size_t pageMask = static_cast<size_t>(sysconf(_SC_PAGESIZE)) - 1;
+    size_t start = offset & ~pageMask;
+    size_t end = min(offset + size, _size);
+
+    madvise(static_cast<char *>(_mapping) + start, end - start, MADV_WILLNEED);
+#endif
+}
+
+void MappedFile::_ReadBuffered(int fd) {
+    _buffer.clear();
+    _size = 0;
+
+    while (true) {
+        if (_buffer.size() - _size < 0x10000)
+            _buffer.resize(max<size_t>(_buffer.size() * 2, 0x40000));
+
+        ssize_t rd = read(fd, _buffer.data() + _size, _buffer.size() - _size);
+
+        if (rd < 0) {
+            close(fd);
+            die("Couldn't read the file!");
+        }
+
+        if (rd == 0)
+            break;
+
+        _size += static_cast<size_t>(rd);
+    }
+
+    _buffer.resize(_size);
+    _buffer.shrink_to_fit();
+    _data = _buffer.data();
+}
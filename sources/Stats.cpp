@@ -0,0 +1,172 @@
+#include "Stats.hpp"
+#include "Trace.hpp"
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+struct PhaseName {
+    const char *label;
+    const char *key; ///< In the JSON output
+};
+
+static const PhaseName g_phaseNames[static_cast<u32>(StatsPhase::Count)] = {
+    {"ELF read", "elfRead"},
+    {"YAML load", "yamlLoad"},
+    {"Enclib load", "encLibLoad"},
+    {"Encrypt/checksum", "encrypt"},
+    {"Segment writes", "segmentWrite"},
+    {"Symbol extraction", "getSymbols"},
+    {"Symbol writes", "symbolWrite"},
+    {"Output write", "outputWrite"},
+};
+
+void ConvertStats::Merge(const ConvertStats &other) {
+    for (u32 i = 0; i < static_cast<u32>(StatsPhase::Count); ++i) {
+        phases[i].wallNs += other.phases[i].wallNs;
+        phases[i].cpuNs += other.phases[i].cpuNs;
+        phases[i].count += other.phases[i].count;
+    }
+
+    conversions += other.conversions;
+    cacheHits += other.cacheHits;
+    bytesRead += other.bytesRead;
+    bytesWritten += other.bytesWritten;
+    elfSymbols += other.elfSymbols;
+    filteredSymbols += other.filteredSymbols;
+    uniqueSymbols += other.uniqueSymbols;
+    writtenSymbols += other.writtenSymbols;
+}
+
+PhaseTimer::PhaseTimer(ConvertStats &stats, StatsPhase phase) : _stats(stats) {
+    Next(phase);
+}
+
+PhaseTimer::~PhaseTimer(void) {
+    Stop();
+}
+
+void PhaseTimer::Next(StatsPhase phase) {
+    Stop();
+    _phase = &_stats.Phase(phase);
+    _wallStart = GetWallTimeNs();
+    _cpuStart = GetThreadCpuTimeNs();
+}
+
+void PhaseTimer::Stop(void) {
+    if (!_phase)
+        return;
+
+    u64 wallEnd = GetWallTimeNs();
+
+    _phase->wallNs += wallEnd - _wallStart;
+    _phase->cpuNs += GetThreadCpuTimeNs() - _cpuStart;
+    _phase->count++;
+
+    // Every phase is also a span of the trace
+    TraceComplete(g_phaseNames[_phase - _stats.phases].label, _wallStart, wallEnd);
+    _phase = nullptr;
+}
+
+u64 GetWallTimeNs(void) {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+u64 GetThreadCpuTimeNs(void) {
+#ifndef _WIN32
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        return static_cast<u64>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+#endif
+    return GetProcessCpuTimeNs();
+}
+
+u64 GetProcessCpuTimeNs(void) {
+#ifndef _WIN32
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        return (static_cast<u64>(usage.ru_utime.tv_sec) + usage.ru_stime.tv_sec) * 1000000000ull
+             + (static_cast<u64>(usage.ru_utime.tv_usec) + usage.ru_stime.tv_usec) * 1000ull;
+#endif
+    return static_cast<u64>(clock()) * (1000000000ull / CLOCKS_PER_SEC);
+}
+
+u64 GetPeakRssKiB(void) {
+#ifndef _WIN32
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+#ifdef __APPLE__
+    // In bytes there, in KiB everywhere else
+    return static_cast<u64>(usage.ru_maxrss) / 1024;
+#else
+    return static_cast<u64>(usage.ru_maxrss);
+#endif
+#else
+    return 0;
+#endif
+}
+
+static string FormatMs(u64 ns) {
+    char buffer[32];
+
+    snprintf(buffer, sizeof(buffer), "%12.3f", ns / 1000000.0);
+    return buffer;
+}
+
+void WriteStatsTable(ostream &out, const ConvertStats &stats, const ProcessStats &process) {
+    char line[96];
+
+    out << "\nConversions: " << stats.conversions << " (" << stats.cacheHits << " from the cache)\n\n";
+    snprintf(line, sizeof(line), "%-20s %12s %12s %8s\n", "Phase", "Wall (ms)", "CPU (ms)", "Count");
+    out << line;
+
+    for (u32 i = 0; i < static_cast<u32>(StatsPhase::Count); ++i) {
+        const PhaseStats &phase = stats.phases[i];
+
+        snprintf(line, sizeof(line), "%-20s %s %s %8u\n", g_phaseNames[i].label,
+            FormatMs(phase.wallNs).c_str(), FormatMs(phase.cpuNs).c_str(), phase.count);
+        out << line;
+    }
+
+    snprintf(line, sizeof(line), "%-20s %s %s\n", "Total (process)", FormatMs(process.wallNs).c_str(), FormatMs(process.cpuNs).c_str());
+    out << line << "\n";
+
+    out << "Bytes read: " << stats.bytesRead << ", written: " << stats.bytesWritten << "\n"
+        << "Symbols: " << stats.elfSymbols << " in the ELF, " << stats.filteredSymbols << " after filtering, "
+        << stats.uniqueSymbols << " after deduplication, " << stats.writtenSymbols << " written\n"
+        << "Peak RSS: " << process.peakRssKiB << " KiB, allocations: " << process.allocations << endl;
+}
+
+void WriteStatsJson(ostream &out, const ConvertStats &stats, const ProcessStats &process) {
+    // Microseconds, so every value is an integer
+    out << "{\"conversions\":" << stats.conversions
+        << ",\"cacheHits\":" << stats.cacheHits
+        << ",\"phases\":{";
+
+    for (u32 i = 0; i < static_cast<u32>(StatsPhase::Count); ++i) {
+        const PhaseStats &phase = stats.phases[i];
+
+        out << (i ? "," : "") << "\"" << g_phaseNames[i].key << "\":{\"wallUs\":" << phase.wallNs / 1000
+            << ",\"cpuUs\":" << phase.cpuNs / 1000 << ",\"count\":" << phase.count << "}";
+    }
+
+    out << "},\"wallUs\":" << process.wallNs / 1000
+        << ",\"cpuUs\":" << process.cpuNs / 1000
+        << ",\"bytesRead\":" << stats.bytesRead
+        << ",\"bytesWritten\":" << stats.bytesWritten
+        << ",\"symbols\":{\"elf\":" << stats.elfSymbols
+        << ",\"filtered\":" << stats.filteredSymbols
+        << ",\"unique\":" << stats.uniqueSymbols
+        << ",\"written\":" << stats.writtenSymbols
+        << "},\"peakRssKiB\":" << process.peakRssKiB
+        << ",\"allocations\":" << process.allocations
+        << "}" << endl;
+}
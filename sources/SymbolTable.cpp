@@ -0,0 +1,268 @@
+#include "SymbolTable.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#define die(msg) {throw runtime_error(msg);}
+
+static inline u32 ReadWord(const u8 *data, u32 index) {
+    u32 word;
+
+    memcpy(&word, data + index * sizeof(u32), sizeof(u32));
+    return le_word(word);
+}
+
+vector<u32> BuildNameIndex(const vector<u32> &nameHashes) {
+    u32 count = static_cast<u32>(nameHashes.size());
+    _3gx_NameIndex index;
+
+    // Short chains and about two bloom bits per symbol and per word bit
+    index.nbBuckets = count / 2 + 1;
+    index.bloomSize = 1;
+    index.bloomShift = 6;
+
+    while (index.bloomSize * 16 < count)
+        index.bloomSize <<= 1;
+
+    u32 bloomFirst = sizeof(_3gx_NameIndex) / sizeof(u32);
+    u32 bucketsFirst = bloomFirst + index.bloomSize;
+    u32 hashesFirst = bucketsFirst + index.nbBuckets;
+    u32 symbolsFirst = hashesFirst + count;
+    vector<u32> out(symbolsFirst + count, 0);
+
+    out[0] = le_word(index.nbBuckets);
+    out[1] = le_word(index.bloomSize);
+    out[2] = le_word(index.bloomShift);
+
+    // Counting sort of the symbols by bucket, keeping the symbol table order within a bucket
+    vector<u32> starts(index.nbBuckets + 1, 0);
+
+    for (u32 hash : nameHashes)
+        ++starts[hash % index.nbBuckets + 1];
+
+    for (u32 b = 0; b < index.nbBuckets; ++b)
+        starts[b + 1] += starts[b];
+
+    for (u32 b = 0; b < index.nbBuckets; ++b)
+        out[bucketsFirst + b] = le_word(starts[b] == starts[b + 1] ? 0xFFFFFFFF : starts[b]);
+
+    vector<u32> fill(starts.begin(), starts.end() - 1);
+
+    for (u32 i = 0; i < count; ++i) {
+        u32 hash = nameHashes[i];
+        u32 bucket = hash % index.nbBuckets;
+        u32 pos = fill[bucket]++;
+        u32 word = _3gx_NameBloomWord(index, hash);
+
+        out[bloomFirst + word] |= le_word(_3gx_NameBloomMask(index, hash));
+        out[hashesFirst + pos] = le_word((hash & ~1u) | (fill[bucket] == starts[bucket + 1] ? 1 : 0));
+        out[symbolsFirst + pos] = le_word(i);
+    }
+
+    return out;
+}
+
+vector<u32> BuildAddrIndex(const vector<_3gx_Symbol> &symbols, u32 baseAddress, u32 topAddress) {
+    _3gx_AddrIndex index;
+
+    index.baseAddress = baseAddress;
+    index.pageShift = _3GX_ADDR_INDEX_PAGE_SHIFT;
+    index.nbPages = topAddress > baseAddress ? ((topAddress - baseAddress - 1) >> index.pageShift) + 1 : 0;
+
+    u32 pagesFirst = sizeof(_3gx_AddrIndex) / sizeof(u32);
+    vector<u32> out(pagesFirst + index.nbPages + 1, 0);
+    u32 count = static_cast<u32>(symbols.size());
+    u32 symbol = 0;
+
+    out[0] = le_word(index.baseAddress);
+    out[1] = le_word(index.pageShift);
+    out[2] = le_word(index.nbPages);
+
+    for (u32 page = 0; page <= index.nbPages; ++page) {
+        u64 pageAddress = baseAddress + (static_cast<u64>(page) << index.pageShift);
+
+        while (symbol < count) {
+            _3gx_Symbol sym(le_word(symbols[symbol].address), 0, le_hword(symbols[symbol].flags), 0);
+
+            if (_3gx_SymbolAddress(sym) >= pageAddress)
+                break;
+            ++symbol;
+        }
+
+        out[pagesFirst + page] = le_word(symbol);
+    }
+
+    return out;
+}
+
+SymbolTable::SymbolTable(const void *file, size_t size) : _file(static_cast<const u8 *>(file)), _size(size) {
+    _3gx_Header header;
+    _3gx_HeaderExtension extension;
+
+    if (size < sizeof(_3gx_Header))
+        die("Invalid 3GX file!");
+
+    memcpy(&header, file, sizeof(header));
+
+    if (le_dword(header.magic) != _3GX_MAGIC && le_dword(header.magic) != _3GX_MAGIC_COMPRESSED)
+        die("Invalid 3GX file!");
+
+    // Absent from the plain files, and a newer version may have appended fields to it
+    if (u32 extensionSize = le_word(header.extensionSize))
+        memcpy(&extension, _Range(sizeof(_3gx_Header), extensionSize), min<u32>(extensionSize, sizeof(extension)));
+
+    _3gx_Symtable &symb = header.symtable;
+
+    _count = le_word(symb.nbSymbols);
+
+    if (!_count)
+        return;
+
+    _symbols = _Range(le_word(symb.symbolsOffset), static_cast<u64>(_count) * sizeof(_3gx_Symbol));
+    _names = reinterpret_cast<const char *>(_Range(le_word(symb.nameTableOffset), 1));
+    _namesSize = size - le_word(symb.nameTableOffset);
+    _addresses.resize(_count);
+
+    for (u32 i = 0; i < _count; ++i)
+        _addresses[i] = _3gx_SymbolAddress(Get(i));
+
+    if (le_word(extension.nameIndexOffset))
+        _LoadNameIndex(le_word(extension.nameIndexOffset));
+
+    if (le_word(extension.addrIndexOffset)) {
+        const u8 *index = _Range(le_word(extension.addrIndexOffset), sizeof(_3gx_AddrIndex));
+
+        _addrIndex.baseAddress = ReadWord(index, 0);
+        _addrIndex.pageShift = ReadWord(index, 1);
+        _addrIndex.nbPages = ReadWord(index, 2);
+
+        if (_addrIndex.pageShift >= 32)
+            die("Invalid symbol address index!");
+
+        _pages = _Range(le_word(extension.addrIndexOffset) + sizeof(_3gx_AddrIndex), (static_cast<u64>(_addrIndex.nbPages) + 1) * 4);
+    }
+}
+
+void SymbolTable::_LoadNameIndex(u32 indexOffset) {
+    const u8 *index = _Range(indexOffset, sizeof(_3gx_NameIndex));
+
+    _nameIndex.nbBuckets = ReadWord(index, 0);
+    _nameIndex.bloomSize = ReadWord(index, 1);
+    _nameIndex.bloomShift = ReadWord(index, 2);
+
+    if (!_nameIndex.nbBuckets || !_nameIndex.bloomSize || (_nameIndex.bloomSize & (_nameIndex.bloomSize - 1)))
+        die("Invalid symbol name index!");
+
+    u32 offset = indexOffset + sizeof(_3gx_NameIndex);
+
+    _bloom = _Range(offset, static_cast<u64>(_nameIndex.bloomSize) * 4);
+    _buckets = _Range(offset += _nameIndex.bloomSize * 4, static_cast<u64>(_nameIndex.nbBuckets) * 4);
+    _hashes = _Range(offset += _nameIndex.nbBuckets * 4, static_cast<u64>(_count) * 4);
+    _indexes = _Range(offset += _count * 4, static_cast<u64>(_count) * 4);
+}
+
+const u8 *SymbolTable::_Range(u32 offset, u64 size) const {
+    if (offset + size > _size)
+        die("The symbol table is out of the file bounds!");
+
+    return _file + offset;
+}
+
+_3gx_Symbol SymbolTable::Get(u32 index) const {
+    const u8 *entry = _symbols + index * sizeof(_3gx_Symbol);
+    u16 size, flags;
+    u32 address, nameOffset;
+
+    memcpy(&address, entry, 4);
+    memcpy(&size, entry + 4, 2);
+    memcpy(&flags, entry + 6, 2);
+    memcpy(&nameOffset, entry + 8, 4);
+
+    return _3gx_Symbol(le_word(address), le_hword(size), le_hword(flags), le_word(nameOffset));
+}
+
+const char *SymbolTable::GetName(u32 index) const {
+    u32 nameOffset = Get(index).nameOffset;
+
+    if (nameOffset >= _namesSize || !memchr(_names + nameOffset, 0, _namesSize - nameOffset))
+        die("Invalid symbol name offset!");
+
+    return _names + nameOffset;
+}
+
+s32 SymbolTable::FindByName(const char *name) const {
+    if (!_bloom) {
+        for (u32 i = 0; i < _count; ++i) {
+            if (!strcmp(GetName(i), name))
+                return static_cast<s32>(i);
+        }
+
+        return -1;
+    }
+
+    u32 hash = _3gx_NameHash(name);
+    u32 mask = _3gx_NameBloomMask(_nameIndex, hash);
+
+    // Most of the missing names stop at the bloom filter
+    if ((ReadWord(_bloom, _3gx_NameBloomWord(_nameIndex, hash)) & mask) != mask)
+        return -1;
+
+    u32 pos = ReadWord(_buckets, hash % _nameIndex.nbBuckets);
+
+    if (pos == 0xFFFFFFFF)
+        return -1;
+
+    for (; pos < _count; ++pos) {
+        u32 chainHash = ReadWord(_hashes, pos);
+
+        if ((chainHash | 1) == (hash | 1)) {
+            u32 index = ReadWord(_indexes, pos);
+
+            if (index < _count && !strcmp(GetName(index), name))
+                return static_cast<s32>(index);
+        }
+
+        if (chainHash & 1)
+            break;
+    }
+
+    return -1;
+}
+
+s32 SymbolTable::FindByAddress(u32 address) const {
+    u32 first = 0, last = _count;
+
+    // The page gives the few symbols to look at
+    if (_pages && address >= _addrIndex.baseAddress) {
+        u32 page = (address - _addrIndex.baseAddress) >> _addrIndex.pageShift;
+
+        if (page < _addrIndex.nbPages) {
+            first = min(ReadWord(_pages, page), _count);
+            last = min(ReadWord(_pages, page + 1), _count);
+        }
+    }
+
+    // Branchless search of the number of symbols starting at or before the address
+    const u32 *base = _addresses.data() + first;
+    u32 length = last - first;
+
+    while (length > 1) {
+        u32 half = length / 2;
+
+        base += (base[half - 1] <= address) ? half : 0;
+        length -= half;
+    }
+
+    first = static_cast<u32>(base - _addresses.data()) + ((length && *base <= address) ? 1 : 0);
+
+    if (!first)
+        return -1;
+
+    u32 index = first - 1;
+
+    // Aliases follow the symbol they rename
+    while (index > 0 && (Get(index).flags & _3GX_SYM__ALTNAME) && _addresses[index - 1] == _addresses[index])
+        --index;
+
+    return static_cast<s32>(index);
+}
@@ -0,0 +1,132 @@
+#include "Symbolize.hpp"
+#include "MappedFile.hpp"
+#include "SymbolTable.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+struct Plugin {
+    unique_ptr<MappedFile> file;
+    unique_ptr<SymbolTable> symbols;
+};
+
+static string FileName(const string &path) {
+    size_t pos = path.find_last_of("/\\");
+    return pos == string::npos ? path : path.substr(pos + 1);
+}
+
+static string Symbolize(const vector<Plugin> &plugins, const map<string, u32> &routes, const string &line) {
+    istringstream tokens(line);
+    string first, second;
+    const Plugin *plugin = &plugins[0];
+
+    if (!(tokens >> first))
+        return line;
+
+    if (tokens >> second) {
+        auto route = routes.find(first);
+
+        if (route == routes.end())
+            return line + " ?? (unknown plugin)";
+
+        plugin = &plugins[route->second];
+        first = second;
+    }
+
+    char *end = nullptr;
+    unsigned long long value = strtoull(first.c_str(), &end, 16);
+
+    // Wider values don't fit the 32-bit address space, they aren't truncated into it
+    if (end == first.c_str() || *end || value > 0xFFFFFFFFull)
+        return line + " ?? (invalid address)";
+
+    u32 address = static_cast<u32>(value);
+
+    s32 index = plugin->symbols->FindByAddress(address);
+
+    // The ELF null symbol is kept in the table, at address 0 and without name
+    if (index < 0 || !*plugin->symbols->GetName(index))
+        return line + " ??";
+
+    char offset[16];
+    snprintf(offset, sizeof(offset), "+0x%X", address - _3gx_SymbolAddress(plugin->symbols->Get(index)));
+
+    return line + " " + plugin->symbols->GetName(index) + offset;
+}
+
+int RunSymbolize(const vector<string> &pluginPaths, const string &addressesPath, u32 threadCount) {
+    vector<Plugin> plugins;
+    map<string, u32> routes;
+    vector<string> lines;
+
+    if (pluginPaths.empty()) {
+        cerr << "No 3GX file to symbolize against!" << endl;
+        return -1;
+    }
+
+    for (const string &path : pluginPaths) {
+        Plugin plugin;
+
+        plugin.file.reset(new MappedFile(path));
+        plugin.symbols.reset(new SymbolTable(plugin.file->Data(), plugin.file->Size()));
+
+        if (!plugin.symbols->Count())
+            cerr << "WARNING: " << path << " has no symbols" << endl;
+
+        routes[FileName(path)] = plugins.size();
+        routes[path] = plugins.size();
+        plugins.push_back(move(plugin));
+    }
+
+    // Read every address first, so they can be split between threads
+    if (addressesPath == "-") {
+        for (string line; getline(cin, line);)
+            lines.push_back(line);
+    }
+
+    else {
+        ifstream input(addressesPath);
+
+        if (!input.is_open()) {
+            cerr << "couldn't open: " << addressesPath << endl;
+            return -1;
+        }
+
+        for (string line; getline(input, line);)
+            lines.push_back(line);
+    }
+
+    if (!threadCount)
+        threadCount = max(1u, thread::hardware_concurrency());
+
+    threadCount = static_cast<u32>(max<size_t>(1, min<size_t>(threadCount, lines.size() / 4096)));
+
+    vector<thread> threads;
+    size_t chunkSize = (lines.size() + threadCount - 1) / threadCount;
+
+    // The results replace the lines in place, which keeps the input order
+    auto work = [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i)
+            lines[i] = Symbolize(plugins, routes, lines[i]);
+    };
+
+    for (u32 i = 1; i < threadCount; ++i)
+        threads.emplace_back(work, min(lines.size(), i * chunkSize), min(lines.size(), (i + 1) * chunkSize));
+
+    work(0, min(lines.size(), chunkSize));
+
+    for (thread &t : threads)
+        t.join();
+
+    for (const string &line : lines)
+        cout << line << '\n';
+
+    cout.flush();
+    return 0;
+}
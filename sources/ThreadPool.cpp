@@ -0,0 +1,109 @@
+#include "ThreadPool.hpp"
+
+// Set on the workers, the pool is checked since a worker may submit to another pool
+static thread_local const ThreadPool *g_workerPool = nullptr;
+static thread_local u32 g_workerIndex = 0;
+
+ThreadPool::ThreadPool(u32 threadCount) {
+    if (!threadCount)
+        threadCount = thread::hardware_concurrency();
+
+    if (!threadCount)
+        threadCount = 1;
+
+    for (u32 i = 0; i < threadCount; ++i)
+        _queues.emplace_back(new WorkQueue());
+
+    for (u32 i = 0; i < threadCount; ++i)
+        _threads.emplace_back(&ThreadPool::_WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool(void) {
+    {
+        lock_guard<mutex> guard(_lock);
+        _stop = true;
+    }
+
+    _wake.notify_all();
+
+    for (thread &t : _threads)
+        t.join();
+}
+
+void ThreadPool::Submit(function<void()> task) {
+    // Tasks spawned by a worker stay on its own queue, others are spread round-robin
+    u32 index = g_workerPool == this ? g_workerIndex
+                                     : _nextQueue++ % static_cast<u32>(_queues.size());
+    {
+        lock_guard<mutex> guard(_queues[index]->lock);
+        _queues[index]->tasks.push_back(move(task));
+    }
+
+    {
+        lock_guard<mutex> guard(_lock);
+        ++_pending;
+        ++_queued;
+    }
+
+    _wake.notify_one();
+}
+
+void ThreadPool::Wait(void) {
+    unique_lock<mutex> guard(_lock);
+    _idle.wait(guard, [this] { return _pending == 0; });
+}
+
+bool ThreadPool::_Pop(u32 index, function<void()> &task) {
+    WorkQueue &queue = *_queues[index];
+    lock_guard<mutex> guard(queue.lock);
+
+    if (queue.tasks.empty())
+        return false;
+
+    task = move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::_Steal(u32 index, function<void()> &task) {
+    u32 count = static_cast<u32>(_queues.size());
+
+    for (u32 i = 1; i < count; ++i) {
+        WorkQueue &queue = *_queues[(index + i) % count];
+        lock_guard<mutex> guard(queue.lock);
+
+        if (queue.tasks.empty())
+            continue;
+
+        task = move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return true;
+    }
+
+    return false;
+}
+
+void ThreadPool::_WorkerLoop(u32 index) {
+    g_workerPool = this;
+    g_workerIndex = index;
+
+    while (true) {
+        function<void()> task;
+
+        if (_Pop(index, task) || _Steal(index, task)) {
+            --_queued;
+            task();
+
+            lock_guard<mutex> guard(_lock);
+            if (--_pending == 0)
+                _idle.notify_all();
+            continue;
+        }
+
+        unique_lock<mutex> guard(_lock);
+        _wake.wait(guard, [this] { return _stop || _queued > 0; });
+
+        if (_stop && _queued == 0)
+            return;
+    }
+}
@@ -0,0 +1,196 @@
+#include "Trace.hpp"
+#include "Stats.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Per thread, 32 bytes each
+#define TRACE_BUFFER_EVENTS (16384)
+
+struct TraceEvent {
+    const char *name;
+    u64 startNs;
+    u64 endNs;
+    u32 fileId; ///< 0 for none
+};
+
+struct TraceBuffer {
+    u32 threadId{0};
+    vector<TraceEvent> events;
+    u64 recorded{0}; ///< Every event since StartTrace, the next one goes to recorded % TRACE_BUFFER_EVENTS
+    atomic<bool> retired{false}; ///< Its thread exited
+};
+
+// Owns the buffer with the registry, which keeps it until the trace is written
+struct ThreadTrace {
+    shared_ptr<TraceBuffer> buffer;
+    u32 fileId{0};
+
+    ~ThreadTrace(void) {
+        if (buffer)
+            buffer->retired = true;
+    }
+};
+
+static atomic<bool> g_tracing{false};
+static u64 g_traceStart{0};
+static mutex g_traceLock;
+static vector<shared_ptr<TraceBuffer>> g_traceBuffers;
+static vector<string> g_traceFiles;
+static map<string, u32> g_traceFileIds;
+static u32 g_nextThreadId{0};
+static thread_local ThreadTrace t_trace;
+
+static TraceBuffer &GetThreadBuffer(void) {
+    if (!t_trace.buffer) {
+        shared_ptr<TraceBuffer> buffer = make_shared<TraceBuffer>();
+        lock_guard<mutex> guard(g_traceLock);
+
+        buffer->events.resize(TRACE_BUFFER_EVENTS);
+        buffer->threadId = g_nextThreadId++;
+        g_traceBuffers.push_back(buffer);
+        t_trace.buffer = buffer;
+    }
+
+    return *t_trace.buffer;
+}
+
+void StartTrace(void) {
+    lock_guard<mutex> guard(g_traceLock);
+    vector<shared_ptr<TraceBuffer>> live;
+
+    // A daemon traces many runs, the threads of the previous ones are gone
+    for (shared_ptr<TraceBuffer> &buffer : g_traceBuffers) {
+        if (buffer->retired)
+            continue;
+
+        buffer->recorded = 0;
+        live.push_back(buffer);
+    }
+
+    g_traceBuffers.swap(live);
+    g_traceFiles.assign(1, string());
+    g_traceFileIds.clear();
+    g_traceStart = GetWallTimeNs();
+    g_tracing = true;
+}
+
+bool IsTracing(void) {
+    return g_tracing.load(memory_order_relaxed);
+}
+
+void TraceComplete(const char *name, u64 startNs, u64 endNs) {
+    if (!IsTracing())
+        return;
+
+    TraceBuffer &buffer = GetThreadBuffer();
+
+    buffer.events[buffer.recorded++ % TRACE_BUFFER_EVENTS] = {name, startNs, endNs, t_trace.fileId};
+}
+
+static void WriteJsonString(ostream &out, const string &value) {
+    out << '"';
+
+    for (unsigned char c : value) {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+
+        else if (c < 0x20) {
+            char escaped[8];
+
+            snprintf(escaped, sizeof(escaped), "\\u%04X", c);
+            out << escaped;
+        }
+
+        else
+            out << c;
+    }
+
+    out << '"';
+}
+
+static void WriteMicroseconds(ostream &out, u64 ns) {
+    char buffer[32];
+
+    snprintf(buffer, sizeof(buffer), "%llu.%03u", static_cast<unsigned long long>(ns / 1000), static_cast<u32>(ns % 1000));
+    out << buffer;
+}
+
+bool WriteTrace(const string &path) {
+    g_tracing = false;
+
+    lock_guard<mutex> guard(g_traceLock);
+    ofstream file(path, ios::out | ios::trunc);
+    u64 dropped = 0;
+    bool first = true;
+
+    if (!file.is_open())
+        return false;
+
+    file << "{\"traceEvents\":[\n";
+
+    for (const shared_ptr<TraceBuffer> &buffer : g_traceBuffers) {
+        u64 count = min<u64>(buffer->recorded, TRACE_BUFFER_EVENTS);
+
+        dropped += buffer->recorded - count;
+
+        // Oldest first
+        for (u64 i = buffer->recorded - count; i < buffer->recorded; ++i) {
+            const TraceEvent &event = buffer->events[i % TRACE_BUFFER_EVENTS];
+
+            file << (first ? "" : ",\n") << "{\"name\":";
+            WriteJsonString(file, event.name);
+            file << ",\"cat\":\"3gxtool\",\"ph\":\"X\",\"ts\":";
+            WriteMicroseconds(file, event.startNs - min(event.startNs, g_traceStart));
+            file << ",\"dur\":";
+            WriteMicroseconds(file, event.endNs - event.startNs);
+            file << ",\"pid\":1,\"tid\":" << buffer->threadId;
+
+            if (event.fileId) {
+                file << ",\"args\":{\"file\":";
+                WriteJsonString(file, g_traceFiles[event.fileId]);
+                file << "}";
+            }
+
+            file << "}";
+            first = false;
+        }
+    }
+
+    file << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":" << dropped << "}}" << endl;
+    return static_cast<bool>(file);
+}
+
+TraceSpan::TraceSpan(const char *name) : _name(name) {
+    if (IsTracing())
+        _start = GetWallTimeNs();
+}
+
+TraceSpan::~TraceSpan(void) {
+    if (_start)
+        TraceComplete(_name, _start, GetWallTimeNs());
+}
+
+TraceFileScope::TraceFileScope(const string &file) : _previous(t_trace.fileId) {
+    if (!IsTracing())
+        return;
+
+    lock_guard<mutex> guard(g_traceLock);
+    auto id = g_traceFileIds.find(file);
+
+    if (id == g_traceFileIds.end()) {
+        id = g_traceFileIds.emplace(file, static_cast<u32>(g_traceFiles.size())).first;
+        g_traceFiles.push_back(file);
+    }
+
+    t_trace.fileId = id->second;
+}
+
+TraceFileScope::~TraceFileScope(void) {
+    t_trace.fileId = _previous;
+}
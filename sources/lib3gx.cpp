@@ -0,0 +1,258 @@
+#include "lib3gx.h"
+#include "lib3gx.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+
+struct lib3gx_enclib {
+    shared_ptr<const EncLib> encLib;
+};
+
+static vector<u8> ConvertContextToBuffer(ConvertContext &context, const void *elfData, size_t elfSize, ostream &log) {
+    context.LoadElf(elfData, elfSize, log);
+
+    const FileImage &image = context.Convert();
+    vector<u8> buffer(image.Size());
+
+    image.CopyTo(buffer.data());
+    return buffer;
+}
+
+vector<u8> ConvertToBuffer(const void *elfData, size_t elfSize, const PluginSettings &settings,
+    const ConvertOptions &options, shared_ptr<const EncLib> encLib, ostream &log) {
+    ConvertContext context(options, make_shared<const PluginSettings>(settings), move(encLib));
+
+    return ConvertContextToBuffer(context, elfData, elfSize, log);
+}
+
+vector<u8> ConvertToBuffer(const void *elfData, size_t elfSize, const string &settingsYaml,
+    const ConvertOptions &options, shared_ptr<const EncLib> encLib, ostream &log) {
+    istringstream settingsFile(settingsYaml);
+    auto settings = make_shared<const PluginSettings>(ParseSettings(settingsFile));
+    ConvertContext context(options, settings, move(encLib));
+
+    log << settings->warnings;
+    return ConvertContextToBuffer(context, elfData, elfSize, log);
+}
+
+// C ABI
+
+// Null when there's nothing to report or no memory left for it
+static char *CopyMessage(const string &message) {
+    if (message.empty())
+        return nullptr;
+
+    char *copy = static_cast<char *>(malloc(message.size() + 1));
+
+    if (copy)
+        memcpy(copy, message.c_str(), message.size() + 1);
+
+    return copy;
+}
+
+static int Fail(int result, const string &message, char **messages) {
+    if (messages)
+        *messages = CopyMessage(message);
+
+    return result;
+}
+
+// The structures may come from an older header, the fields it didn't know about keep their default
+template <typename T>
+static T CopyVersioned(const T *src) {
+    T dst;
+
+    memset(&dst, 0, sizeof(T));
+    dst.size = sizeof(T);
+
+    if (src)
+        memcpy(&dst, src, min<size_t>(src->size, sizeof(T)));
+
+    return dst;
+}
+
+static ConvertOptions GetConvertOptions(const lib3gx_options *options) {
+    lib3gx_options opts = CopyVersioned(options);
+    ConvertOptions converted;
+
+    converted.writeSymbols = !(opts.flags & LIB3GX_DISCARD_SYMBOLS);
+    converted.writeNameIndex = (opts.flags & LIB3GX_NAME_INDEX) != 0;
+    converted.writeAddrIndex = (opts.flags & LIB3GX_ADDR_INDEX) != 0;
+    converted.compress = (opts.flags & LIB3GX_COMPRESS) != 0;
+    converted.trimData = (opts.flags & LIB3GX_TRIM_DATA) != 0;
+    converted.alignment = opts.alignment;
+
+    if (converted.alignment && (converted.alignment < 16 || (converted.alignment & (converted.alignment - 1))))
+        throw invalid_argument("The alignment must be a power of 2 of at least 16 bytes!");
+
+    return converted;
+}
+
+static PluginSettings GetPluginSettings(const lib3gx_settings *settings) {
+    lib3gx_settings src = CopyVersioned(settings);
+    PluginSettings converted;
+    _3gx_Infos infos;
+
+    if (src.compatibility > LIB3GX_COMPAT_ANY)
+        throw invalid_argument("Invalid compatibility!");
+
+    if (src.memory_size > LIB3GX_MEMORY_10MIB)
+        throw invalid_argument("Invalid memory size!");
+
+    if (src.target_count && !src.targets)
+        throw invalid_argument("Missing targets!");
+
+    converted.version = ((src.version_major & 0xFF) << 24) | ((src.version_minor & 0xFF) << 16) | ((src.version_revision & 0xFF) << 8);
+    converted.infos.author = src.author ? src.author : "";
+    converted.infos.title = src.title ? src.title : "";
+    converted.infos.summary = src.summary ? src.summary : "";
+    converted.infos.description = src.description ? src.description : "";
+    converted.infos.targets.assign(src.targets, src.targets + src.target_count);
+
+    infos.compatibility = src.compatibility;
+    infos.memoryRegionSize = src.memory_size;
+    infos.eventsSelfManaged = (src.flags & LIB3GX_EVENTS_SELF_MANAGED) != 0;
+    infos.swapNotNeeded = (src.flags & LIB3GX_SWAP_NOT_NEEDED) != 0;
+    converted.flags = infos.flags;
+    return converted;
+}
+
+static int Convert(const void *elf, size_t elfSize, shared_ptr<const PluginSettings> settings,
+    const ConvertOptions &options, const lib3gx_enclib *enclib,
+    void **output, size_t *outputSize, ostringstream &log, char **messages) {
+    try {
+        ConvertContext context(options, move(settings), enclib ? enclib->encLib : nullptr);
+
+        context.LoadElf(elf, elfSize, log);
+
+        // Straight into the caller's buffer, without an intermediate copy
+        const FileImage &image = context.Convert();
+        void *buffer = malloc(max<size_t>(image.Size(), 1));
+
+        if (!buffer)
+            return Fail(LIB3GX_ERROR_MEMORY, "Out of memory!", messages);
+
+        image.CopyTo(buffer);
+        *output = buffer;
+        *outputSize = image.Size();
+    }
+
+    catch (const bad_alloc &) {
+        return Fail(LIB3GX_ERROR_MEMORY, "Out of memory!", messages);
+    }
+
+    catch (const exception &e) {
+        return Fail(LIB3GX_ERROR_CONVERSION, log.str() + e.what(), messages);
+    }
+
+    if (messages)
+        *messages = CopyMessage(log.str());
+
+    return LIB3GX_OK;
+}
+
+uint32_t lib3gx_abi_version(void) {
+    return LIB3GX_ABI_VERSION;
+}
+
+int lib3gx_enclib_open(const char *path, lib3gx_enclib **enclib, char **error) {
+    if (error)
+        *error = nullptr;
+
+    if (!path || !enclib)
+        return Fail(LIB3GX_ERROR_ARGUMENT, "Missing argument!", error);
+
+    try {
+        *enclib = new lib3gx_enclib{make_shared<const EncLib>(path)};
+    }
+
+    catch (const bad_alloc &) {
+        return Fail(LIB3GX_ERROR_MEMORY, "Out of memory!", error);
+    }
+
+    catch (const exception &e) {
+        return Fail(LIB3GX_ERROR_ENCLIB, e.what(), error);
+    }
+
+    return LIB3GX_OK;
+}
+
+void lib3gx_enclib_close(lib3gx_enclib *enclib) {
+    // Conversions still running keep their own reference
+    delete enclib;
+}
+
+int lib3gx_convert(const void *elf, size_t elf_size, const lib3gx_settings *settings,
+    const lib3gx_options *options, const lib3gx_enclib *enclib,
+    void **output, size_t *output_size, char **messages) {
+    shared_ptr<const PluginSettings> plgSettings;
+    ConvertOptions convertOptions;
+    ostringstream log;
+
+    if (messages)
+        *messages = nullptr;
+
+    if (!elf || !settings || !output || !output_size)
+        return Fail(LIB3GX_ERROR_ARGUMENT, "Missing argument!", messages);
+
+    try {
+        plgSettings = make_shared<const PluginSettings>(GetPluginSettings(settings));
+        convertOptions = GetConvertOptions(options);
+    }
+
+    catch (const bad_alloc &) {
+        return Fail(LIB3GX_ERROR_MEMORY, "Out of memory!", messages);
+    }
+
+    catch (const exception &e) {
+        return Fail(LIB3GX_ERROR_ARGUMENT, e.what(), messages);
+    }
+
+    return Convert(elf, elf_size, plgSettings, convertOptions, enclib, output, output_size, log, messages);
+}
+
+int lib3gx_convert_yaml(const void *elf, size_t elf_size, const char *settings, size_t settings_size,
+    const lib3gx_options *options, const lib3gx_enclib *enclib,
+    void **output, size_t *output_size, char **messages) {
+    shared_ptr<const PluginSettings> plgSettings;
+    ConvertOptions convertOptions;
+    ostringstream log;
+
+    if (messages)
+        *messages = nullptr;
+
+    if (!elf || !settings || !output || !output_size)
+        return Fail(LIB3GX_ERROR_ARGUMENT, "Missing argument!", messages);
+
+    try {
+        convertOptions = GetConvertOptions(options);
+    }
+
+    catch (const exception &e) {
+        return Fail(LIB3GX_ERROR_ARGUMENT, e.what(), messages);
+    }
+
+    try {
+        istringstream settingsFile(string(settings, settings_size));
+
+        plgSettings = make_shared<const PluginSettings>(ParseSettings(settingsFile));
+        log << plgSettings->warnings;
+    }
+
+    catch (const bad_alloc &) {
+        return Fail(LIB3GX_ERROR_MEMORY, "Out of memory!", messages);
+    }
+
+    catch (const exception &e) {
+        return Fail(LIB3GX_ERROR_SETTINGS, string("Couldn't parse the settings: ") + e.what(), messages);
+    }
+
+    return Convert(elf, elf_size, plgSettings, convertOptions, enclib, output, output_size, log, messages);
+}
+
+void lib3gx_free(void *ptr) {
+    free(ptr);
+}
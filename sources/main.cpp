@@ -1,308 +1,706 @@
 #include "types.hpp"
 #include "3gx.hpp"
-#include "ElfConvert.hpp"
+#include "AllocationCounter.hpp"
+#include "ConversionCache.hpp"
+#include "ConvertContext.hpp"
+#include "Daemon.hpp"
+#include "EncLib.hpp"
+#include "FileImage.hpp"
+#include "Hash.hpp"
+#include "MappedFile.hpp"
+#include "Stats.hpp"
+#include "Symbolize.hpp"
+#include "ThreadPool.hpp"
+#include "Trace.hpp"
 #include <yaml.h>
 #include "cxxopts.hpp"
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <functional>
 #include <vector>
 #include <string>
+#include <sstream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <cstdio>
-#include <cctype>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef _WIN32
+#include <io.h>
+#endif
 
 #define TOOL_VERSION "v0.0.1"
 using namespace std;
 
-static bool g_silentMode = false;
-static bool g_discardSymbols = false;
-static string g_author;
-static string g_title;
-static string g_summary;
-static string g_description;
-static vector<u32> g_targets;
-string g_enclibpath{""};
+// Command line of one invocation
+struct ToolOptions {
+    bool help{false};
+    bool silentMode{false};
+    ConvertOptions convert;
+    string enclibPath;
+    string batchManifest;
+    u32 jobs{0};
+    bool symbolize{false};
+    string addressesPath{"-"};
+    string cacheDir;
+    u64 cacheMaxSize{1024ull << 20};
+    bool writeIfChanged{false};
+    bool writeDepfile{false};
+    string depfilePath;
+    string daemonSocket;
+    string statsFormat; ///< "table" or "json", empty for no statistics
+    string statsPath;
+    string tracePath;
+};
+
+// Identifies a version of a file. Timestamps can't tell apart two saves within their
+// granularity, so the contents are hashed: the files kept warm are small.
+struct FileStamp {
+    dev_t device{0};
+    ino_t inode{0};
+    off_t size{0};
+    u64 hash{0};
+
+    bool Read(const string &path) {
+        struct stat st;
+        Hasher hasher;
+
+        if (stat(path.c_str(), &st) != 0)
+            return false;
+
+        try {
+            MappedFile file(path);
+
+            hasher.Update(file.Data(), file.Size());
+        }
+
+        catch (exception &) {
+            return false;
+        }
+
+        device = st.st_dev;
+        inode = st.st_ino;
+        size = st.st_size;
+        hash = hasher.Digest();
+        return true;
+    }
 
-#define MAKE_VERSION(major, minor, revision) \
-    (((major) << 24)|((minor) << 16)|((revision) << 8))
+    bool operator==(const FileStamp &other) const {
+        return device == other.device && inode == other.inode && size == other.size && hash == other.hash;
+    }
+};
+
+// What a daemon keeps loaded between its requests, until the files change. Paths are
+// relative to the directory of each request, so the stamps also tell different files apart.
+struct WarmState {
+    mutex lock;
+    map<string, pair<FileStamp, shared_ptr<const PluginSettings>>> settings;
+    map<string, pair<FileStamp, shared_ptr<const EncLib>>> encLibs;
+};
+
+// Everything the conversions of one invocation share, none of it is mutated while they run
+struct Session {
+    ToolOptions options;
+    unique_ptr<ConversionCache> cache;
+    shared_ptr<const EncLib> encLib;
+    WarmState *warm{nullptr};
+};
+
+struct ConvertJob {
+    string elfPath;
+    string settingsPath;
+    string outputPath;
+};
+
+// What a request needs from the client which the daemon can't provide
+bool IsForwardable(const vector<string> &args) {
+    for (size_t i = 1; i < args.size(); ++i) {
+        const string &arg = args[i];
+
+        if (arg == "-" || arg == "--daemon" || arg == "--symbolize" || arg == "-h" || arg == "--help")
+            return false;
+    }
+
+    return true;
+}
 
-void CheckOptions(int &argc, const char **argv) {
+void PrintUsage(const char *name) {
+    cout <<  " - Builds plugin files to be used by Luma3DS\n" \
+                 "Usage:\n"
+         <<  name << " [OPTION...] <input.bin> <settings.plgInfo> <output.3gx>\n"
+         <<  name << " [OPTION...] --batch <manifest.yml>\n"
+         <<  name << " [OPTION...] --symbolize [--addresses <file>] <plugin.3gx>...\n"
+         <<  name << " --daemon <socket>" << endl;
+}
+
+ToolOptions CheckOptions(int &argc, const char **argv) {
     cxxopts::Options options(argv[0], "");
+    ToolOptions parsed;
 
     options.add_options()
         ("d,discard-symbols", "Don't include the symbols in the file")
         ("s,silent", "Don't display the text (except errors)")
         ("e,enclib", "Encryption shared library", cxxopts::value<string>())
+        ("name-index", "Add an index to look the symbols up by name")
+        ("addr-index", "Add an index to look the symbols up by address")
+        ("compress", "Compress the segments (3GX$0003 format, needs a loader supporting it)")
+        ("trim-data", "Move the trailing zeroes of the data segment to the bss")
+        ("align", "Align the segments and the symbol table in the file, e.g. 512 (SD sector) or 4096 (page)", cxxopts::value<u32>())
+        ("b,batch", "Convert every job listed in a YAML manifest", cxxopts::value<string>())
+        ("j,jobs", "Number of concurrent batch jobs (default: one per core)", cxxopts::value<u32>())
+        ("symbolize", "Resolve addresses against the symbols of the given 3GX files")
+        ("addresses", "File listing the addresses to symbolize (default: stdin)", cxxopts::value<string>())
+        ("MD", "Write a make/ninja depfile listing the inputs next to the output (<output.3gx>.d)")
+        ("MF", "Write the depfile to this path instead", cxxopts::value<string>())
+        ("write-if-changed", "Don't touch the output file if its contents are already the same")
+        ("cache-dir", "Reuse the conversions stored in this directory and store the new ones", cxxopts::value<string>())
+        ("cache-size", "Size the cache is trimmed to in MiB, 0 for no limit (default: 1024)", cxxopts::value<u32>())
+        ("daemon", "Serve the conversions requested by the clients on this Unix socket (see " DAEMON_SOCKET_ENV ")", cxxopts::value<string>())
+        ("stats", "Print the time spent in each phase, the I/O, symbol counts and memory use, as a table or as json", cxxopts::value<string>()->implicit_value("table"))
+        ("stats-file", "Write the statistics to this file instead", cxxopts::value<string>())
+        ("trace", "Write a timeline of the conversions to this file, as Chrome trace events", cxxopts::value<string>())
+        ("parallel-symbols", "Symbol count from which the symbol table is processed on every core, 0 to disable (default: 65536)", cxxopts::value<u32>())
         ("h,help", "Print help");
 
     auto result = options.parse(argc, argv);
 
+    // Reported rather than handled here, a daemon serving the request mustn't exit
     if (result.count("help")) {
-      cout <<  " - Builds plugin files to be used by Luma3DS\n" \
-                    "Usage:\n"
-                <<  argv[0] << " [OPTION...] <input.bin> <settings.plgInfo> <output.3gx>" << endl;
-      exit(0);
+        parsed.help = true;
+        return parsed;
     }
 
-    g_silentMode = result.count("silent");
-    g_discardSymbols = result.count("discard-symbols");
+    parsed.silentMode = result.count("silent");
+    parsed.convert.writeSymbols = !result.count("discard-symbols");
+    parsed.convert.writeNameIndex = result.count("name-index");
+    parsed.convert.writeAddrIndex = result.count("addr-index");
+    parsed.convert.compress = result.count("compress");
+    parsed.convert.trimData = result.count("trim-data");
+
+    if (result.count("align")) {
+        u32 alignment = result["align"].as<u32>();
+
+        if (alignment < 16 || (alignment & (alignment - 1)))
+            throw runtime_error("The alignment must be a power of 2 of at least 16 bytes!");
+
+        parsed.convert.alignment = alignment;
+    }
 
     if (result.count("enclib"))
-        g_enclibpath = result["enclib"].as<string>();
+        parsed.enclibPath = result["enclib"].as<string>();
+
+    if (result.count("batch"))
+        parsed.batchManifest = result["batch"].as<string>();
+
+    if (result.count("jobs"))
+        parsed.jobs = result["jobs"].as<u32>();
+
+    parsed.symbolize = result.count("symbolize");
+
+    if (result.count("addresses"))
+        parsed.addressesPath = result["addresses"].as<string>();
+
+    if (result.count("parallel-symbols"))
+        parsed.convert.parallelSymbolsThreshold = result["parallel-symbols"].as<u32>();
+
+    parsed.writeIfChanged = result.count("write-if-changed");
+    parsed.writeDepfile = result.count("MD") || result.count("MF");
+
+    if (result.count("MF"))
+        parsed.depfilePath = result["MF"].as<string>();
+
+    if (result.count("daemon"))
+        parsed.daemonSocket = result["daemon"].as<string>();
+
+    if (result.count("cache-dir"))
+        parsed.cacheDir = result["cache-dir"].as<string>();
+
+    if (result.count("cache-size"))
+        parsed.cacheMaxSize = static_cast<u64>(result["cache-size"].as<u32>()) << 20;
+
+    if (result.count("trace"))
+        parsed.tracePath = result["trace"].as<string>();
+
+    if (result.count("stats")) {
+        parsed.statsFormat = result["stats"].as<string>();
+
+        if (parsed.statsFormat != "table" && parsed.statsFormat != "json")
+            throw runtime_error("The statistics can be printed as a table or as json!");
+    }
+
+    if (result.count("stats-file")) {
+        parsed.statsPath = result["stats-file"].as<string>();
+
+        if (parsed.statsFormat.empty())
+            parsed.statsFormat = "table";
+    }
+
+    return parsed;
 }
 
-u32 GetVersion(YAML::Node &settings) {
-    u32 major = 0, minor = 0, revision = 0;
+// Loaded once per version of the file when kept warm by the daemon
+template <typename T>
+shared_ptr<const T> LoadWarm(WarmState *warm, map<string, pair<FileStamp, shared_ptr<const T>>> WarmState::*entries,
+                             const string &path, function<shared_ptr<const T>(void)> load) {
+    FileStamp stamp;
+
+    if (!warm || !stamp.Read(path))
+        return load();
 
-    if (settings["Version"]) {
-        auto map = settings["Version"];
+    shared_ptr<const T> stale;
 
-        if (map["Major"])
-            major = map["Major"].as<u32>();
+    {
+        lock_guard<mutex> guard(warm->lock);
+        auto cached = (warm->*entries).find(path);
 
-        if (map["Minor"])
-            minor = map["Minor"].as<u32>();
+        if (cached != (warm->*entries).end()) {
+            if (cached->second.first == stamp)
+                return cached->second.second;
 
-        if (map["Revision"])
-            revision = map["Revision"].as<u32>();
+            stale = move(cached->second.second);
+            (warm->*entries).erase(cached);
+        }
     }
 
-    return MAKE_VERSION(major, minor, revision);
+    // Released before reloading, or dlopen would hand the old enclib back
+    stale.reset();
+
+    shared_ptr<const T> loaded = load();
+    lock_guard<mutex> guard(warm->lock);
+
+    (warm->*entries)[path] = make_pair(stamp, loaded);
+    return loaded;
 }
 
-void GetInfos(YAML::Node &settings) {
-    if (settings["Author"])
-        g_author = settings["Author"].as<string>();
+shared_ptr<const PluginSettings> LoadSettings(const Session &session, const string &settingsPath, ConvertStats &stats) {
+    PhaseTimer timer(stats, StatsPhase::YamlLoad);
 
-    if (settings["Title"])
-        g_title = settings["Title"].as<string>();
+    return LoadWarm<PluginSettings>(session.warm, &WarmState::settings, settingsPath, [&] {
+        struct stat st;
 
-    if (settings["Summary"])
-        g_summary = settings["Summary"].as<string>();
+        if (stat(settingsPath.c_str(), &st) == 0)
+            stats.bytesRead += st.st_size;
 
-    if (settings["Description"])
-        g_description = settings["Description"].as<string>();
+        return make_shared<const PluginSettings>(LoadSettingsFile(settingsPath));
+    });
 }
 
-_3gx_Infos::Compatibility GetCompatibility(YAML::Node &settings) {
-    if (settings["Compatibility"]) {
-        string value = settings["Compatibility"].as<string>();
-        transform(value.begin(), value.end(), value.begin(),
-            [](unsigned char c){ return tolower(c);});
+shared_ptr<const EncLib> LoadEncLib(const Session &session, const string &encLibPath, ConvertStats &stats) {
+    PhaseTimer timer(stats, StatsPhase::EncLibLoad);
 
-        if (value == "console")
-            return _3gx_Infos::Compatibility::CONSOLE;
+    return LoadWarm<EncLib>(session.warm, &WarmState::encLibs, encLibPath, [&] {
+        return make_shared<const EncLib>(encLibPath);
+    });
+}
 
-        else if (value == "citra")
-            return _3gx_Infos::Compatibility::CITRA;
+// Everything the output depends on, as read from the inputs rather than their raw files
+u64 GetCacheKey(const ConvertContext &context) {
+    Hasher hasher;
 
-        else if (value == "any")
-            return _3gx_Infos::Compatibility::CONSOLE_CITRA;
+    hasher.UpdateString(TOOL_VERSION);
+    hasher.UpdateWord(CONVERSION_CACHE_VERSION);
+    hasher.UpdateWord(sizeof(_3gx_Header));
+    hasher.UpdateWord(sizeof(_3gx_HeaderExtension));
+    context.HashInputs(hasher);
+    return hasher.Digest();
+}
 
-        cout << "Invalid compatibility entry in the plugin info file." \
-        "Please set the \"Compatibility\" configuration. (Possible values: \"Console\", \"Citra\", \"Any\")." \
-        "Assuming compatibility mode: \"Any\"" << endl;
-        return _3gx_Infos::Compatibility::CONSOLE_CITRA;
-    }
+// Make syntax, which ninja understands too
+string EscapeDepfilePath(const string &path) {
+    string escaped;
 
-    else {
-        cout << "Missing compatibility entry in the plugin info file. " \
-        "Please set the \"Compatibility\" configuration. (Possible values: \"Console\", \"Citra\", \"Any\"). " \
-        "Assuming compatibility mode: \"Any\"" << endl;
-        return _3gx_Infos::Compatibility::CONSOLE_CITRA;
+    for (char c : path) {
+        if (c == ' ' || c == '#')
+            escaped += '\\';
+
+        else if (c == '$')
+            escaped += '$';
+
+        escaped += c;
     }
+
+    return escaped;
+}
+
+void WriteDepfile(const Session &session, const ConvertJob &job) {
+    TraceSpan span("Depfile write");
+    const ToolOptions &options = session.options;
+    string path = options.depfilePath.empty() ? job.outputPath + ".d" : options.depfilePath;
+    ofstream depfile(path, ios::out | ios::trunc);
+
+    if (!depfile.is_open())
+        throw runtime_error("couldn't open: " + path);
+
+    depfile << EscapeDepfilePath(job.outputPath) << ":";
+
+    // stdin isn't something the build system can track
+    if (job.elfPath != "-")
+        depfile << " " << EscapeDepfilePath(job.elfPath) << " \\\n ";
+
+    depfile << " " << EscapeDepfilePath(job.settingsPath);
+
+    if (!options.enclibPath.empty())
+        depfile << " \\\n  " << EscapeDepfilePath(options.enclibPath);
+
+    depfile << endl;
+
+    if (!depfile)
+        throw runtime_error("Couldn't write the file: " + path);
 }
 
-_3gx_Infos::MemorySize GetMemorySize(YAML::Node &settings) {
-    if (settings["MemorySize"]) {
-        string value = settings["MemorySize"].as<string>();
-        transform(value.begin(), value.end(), value.begin(),
-            [](unsigned char c){ return tolower(c);});
+void ConvertPlugin(const Session &session, const ConvertJob &job, ostream &log, bool verbose, ConvertStats &stats) {
+    const ToolOptions &options = session.options;
+    ConversionCache *cache = session.cache.get();
+    bool toStdout = job.outputPath == "-";
+    TraceFileScope traceFile(job.elfPath);
+
+    if (verbose)
+        log << "Processing settings..." << endl;
+
+    shared_ptr<const PluginSettings> settings = LoadSettings(session, job.settingsPath, stats);
+    ConvertContext context(options.convert, settings, session.encLib);
+
+    log << settings->warnings;
+    context.LoadElf(job.elfPath, log);
+    stats.conversions++;
 
-        if (value == "2mib")
-            return _3gx_Infos::MemorySize::_2MiB;
+    u64 cacheKey = 0;
 
-        else if (value == "5mib")
-            return _3gx_Infos::MemorySize::_5MiB;
+    if (cache) {
+        TraceSpan span("Cache lookup");
 
-        else if (value == "10mib")
-            return _3gx_Infos::MemorySize::_10MiB;
+        cacheKey = GetCacheKey(context);
 
-        cout << "Invalid memory size entry in the plugin info file." \
-        "Please set the \"MemorySize\" configuration. (Possible values: \"2MiB\", \"5MiB\", \"10MiB\")." \
-        "Assuming memory size: \"5MiB\"" << endl;
-        return _3gx_Infos::MemorySize::_5MiB;
+        if (toStdout ? cache->FetchToFd(cacheKey, STDOUT_FILENO) : cache->Fetch(cacheKey, job.outputPath, options.writeIfChanged)) {
+            stats.Merge(context.GetStats());
+            stats.cacheHits++;
+
+            if (options.writeDepfile)
+                WriteDepfile(session, job);
+
+            if (verbose)
+                log << "Fetched the conversion from the cache" << endl << "Done" << endl;
+
+            return;
+        }
     }
 
+    if (verbose)
+        log << "Creating file..." << endl;
+
+    const FileImage &image = context.Convert();
+
+    if (verbose && options.convert.trimData)
+        log << "Moved " << context.GetTrimmedDataSize() << " bytes of zeroes from the data segment to the bss" << endl;
+
+    if (verbose && options.convert.compress) {
+        const _3gx_Executable &exec = context.GetHeader().executable;
+        const _3gx_Compression &comp = context.GetHeaderExtension().compression;
+        u32 size = exec.codeSize + exec.rodataSize + exec.dataSize;
+        u32 compressedSize = (comp.codeCompressedSize ? comp.codeCompressedSize : exec.codeSize)
+                           + (comp.rodataCompressedSize ? comp.rodataCompressedSize : exec.rodataSize)
+                           + (comp.dataCompressedSize ? comp.dataCompressedSize : exec.dataSize);
+
+        log << "Compressed the executable from " << size << " to " << compressedSize << " bytes" << endl;
+    }
+
+    stats.Merge(context.GetStats());
+    PhaseTimer timer(stats, StatsPhase::OutputWrite);
+
+    // Every offset is already known, so even a pipe gets the whole file in a single pass
+    if (toStdout) {
+        if (cache && cache->Store(cacheKey, image))
+            stats.bytesWritten += image.Size();
+
+        image.WriteToFd(STDOUT_FILENO);
+        stats.bytesWritten += image.Size();
+    }
+
+    // Write the whole file at once, the cache gets its own copy
     else {
-        cout << "Missing memory size entry in the plugin info file." \
-        "Please set the \"MemorySize\" configuration. (Possible values: \"2MiB\", \"5MiB\", \"10MiB\")." \
-        "Assuming memory size: \"5MiB\"" << endl;
-        return _3gx_Infos::MemorySize::_5MiB;
+        if (cache && cache->Store(cacheKey, image))
+            stats.bytesWritten += image.Size();
+
+        if (!options.writeIfChanged) {
+            image.WriteToFile(job.outputPath);
+            stats.bytesWritten += image.Size();
+        }
+
+        else if (image.WriteToFileIfChanged(job.outputPath))
+            stats.bytesWritten += image.Size();
+
+        else if (verbose)
+            log << "The output is already up to date" << endl;
     }
+
+    timer.Stop();
+
+    if (options.writeDepfile)
+        WriteDepfile(session, job);
+
+    if (verbose)
+        log << "Done" << endl;
 }
 
-bool GetEventsSelfManaged(YAML::Node &settings) {
-    if (settings["EventsSelfManaged"]) {
-        string value = settings["EventsSelfManaged"].as<string>();
-        transform(value.begin(), value.end(), value.begin(),
-            [](unsigned char c){ return tolower(c);});
+vector<ConvertJob> LoadManifest(const string &manifestPath) {
+    YAML::Node manifest = YAML::LoadFile(manifestPath);
+    vector<ConvertJob> jobs;
 
-        return value == "true";
+    if (!manifest.IsSequence())
+        throw runtime_error("The batch manifest must be a list of jobs!");
+
+    for (const YAML::Node &entry : manifest) {
+        if (!entry["Elf"] || !entry["PlgInfo"] || !entry["Output"])
+            throw runtime_error("Every batch job needs an \"Elf\", a \"PlgInfo\" and an \"Output\" entry!");
+
+        jobs.push_back({entry["Elf"].as<string>(), entry["PlgInfo"].as<string>(), entry["Output"].as<string>()});
+
+        if (jobs.back().elfPath == "-" || jobs.back().outputPath == "-")
+            throw runtime_error("Batch jobs can't use stdin or stdout!");
     }
 
-    return false;
+    return jobs;
 }
 
-bool GetSwapNotNeeded(YAML::Node &settings) {
-    if (settings["SwapNotNeeded"]) {
-        string value = settings["SwapNotNeeded"].as<string>();
-        transform(value.begin(), value.end(), value.begin(),
-            [](unsigned char c){ return tolower(c);});
+int RunBatch(const Session &session, const vector<ConvertJob> &jobs, ConvertStats &stats) {
+    bool silentMode = session.options.silentMode;
+    vector<u8> failed(jobs.size(), 0);
+    vector<ConvertStats> jobStats(jobs.size());
+    mutex outputLock;
+    ThreadPool pool(session.options.jobs);
+
+    if (!silentMode)
+        cout << "Converting " << jobs.size() << " plugins on " << pool.GetThreadCount() << " threads..." << endl;
+
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        u64 submitted = IsTracing() ? GetWallTimeNs() : 0;
+
+        pool.Submit([&, i, submitted] {
+            const ConvertJob &job = jobs[i];
+            TraceFileScope traceFile(job.elfPath);
+            ostringstream log;
+            string error;
+
+            // The time spent waiting for a free thread
+            if (submitted)
+                TraceComplete("Queued", submitted, GetWallTimeNs());
+
+            TraceSpan span("Batch job");
 
-        return value == "true";
+            try {
+                ConvertPlugin(session, job, log, false, jobStats[i]);
+            }
+
+            catch (exception &e) {
+                remove(job.outputPath.c_str());
+                error = e.what();
+                failed[i] = 1;
+            }
+
+            // Print the whole report of the job at once so the jobs don't interleave
+            lock_guard<mutex> guard(outputLock);
+
+            if (failed[i])
+                cerr << "[FAILED] " << job.outputPath << ": " << error << endl;
+
+            else if (!silentMode)
+                cout << "[OK] " << job.outputPath << endl;
+
+            if (!silentMode)
+                cout << log.str();
+        });
     }
 
-    return false;
+    pool.Wait();
+
+    for (const ConvertStats &job : jobStats)
+        stats.Merge(job);
+
+    size_t failures = count(failed.begin(), failed.end(), 1);
+
+    if (!silentMode)
+        cout << (jobs.size() - failures) << "/" << jobs.size() << " plugins converted" << endl;
+
+    return failures ? -1 : 0;
 }
 
-void GetTitles(YAML::Node &settings) {
-    if (settings["Targets"]) {
-        auto list =  settings["Targets"];
+// Either to the output or to --stats-file
+void WriteStats(const ToolOptions &options, const ConvertStats &stats, const ProcessStats &process) {
+    ofstream file;
+    ostream *out = &cout;
 
-        if (list.size() >= 1 && list[0].as<u32>() != 0) {
-            for (u32 i = 0; i < list.size(); ++i)
-                g_targets.push_back(list[i].as<u32>());
-        }
+    if (!options.statsPath.empty()) {
+        file.open(options.statsPath, ios::out | ios::trunc);
+
+        if (!file.is_open())
+            throw runtime_error("couldn't open: " + options.statsPath);
+
+        out = &file;
     }
+
+    if (options.statsFormat == "json")
+        WriteStatsJson(*out, stats, process);
+    else
+        WriteStatsTable(*out, stats, process);
+
+    if (!*out)
+        throw runtime_error("Couldn't write the statistics!");
 }
 
-int main(int argc, const char **argv) {
+int RunTool(int argc, const char **argv, WarmState *warm) {
     int ret = 0;
+    const char *outputPath = nullptr;
+    streambuf *stdoutBuffer = cout.rdbuf();
+    Session session;
+    const ToolOptions &options = session.options;
+    ConvertStats stats;
+    ProcessStats process;
+    u64 allocationsStart = GetAllocationCount();
+
+    process.wallNs = GetWallTimeNs();
+    process.cpuNs = GetProcessCpuTimeNs();
+    session.warm = warm;
 
     try {
-        CheckOptions(argc, argv);
+        session.options = CheckOptions(argc, argv);
 
-        if (!g_silentMode)
-            cout   <<  "\n" \
-                            "3DS Game eXtension Tool " TOOL_VERSION "\n" \
-                            "--------------------------\n\n";
-
-        if (argc < 4) {
-            if (!g_silentMode)
-                cout   <<  " - Builds plugin files to be used by Luma3DS\n" \
-                                "Usage:\n"
-                            <<  argv[0] << " [OPTION...] <input.bin> <settings.plgInfo> <output.3gx>" << endl;
-            ret = -1;
+        if (options.help) {
+            PrintUsage(argv[0]);
             goto exit;
         }
 
-        _3gx_Header header;
-        ElfConvert elfConvert(argv[1]);
-        YAML::Node settings;
-        ifstream settingsFile;
-        ifstream codeFile;
-        ofstream outputFile;
+        CountAllocations(!options.statsFormat.empty());
 
-        // Open files
-        settingsFile.open(argv[2], ios::in);
-        outputFile.open(argv[3], ios::out | ios::trunc | ios::binary);
+        if (!options.tracePath.empty())
+            StartTrace();
 
-        if (!settingsFile.is_open()) {
-            cerr << "couldn't open: " << argv[2] << endl;
-            ret = -1;
-            goto exit;
+        // The file goes to stdout, so does nothing else
+        if (options.batchManifest.empty() && !options.symbolize && argc >= 4 && string(argv[3]) == "-") {
+            cout.rdbuf(cerr.rdbuf());
+#ifdef _WIN32
+            _setmode(STDOUT_FILENO, O_BINARY);
+#endif
+
+            if (options.writeDepfile && options.depfilePath.empty())
+                throw runtime_error("The depfile of stdout needs a path, use --MF!");
         }
 
-        if (!outputFile.is_open()) {
-            cerr << "couldn't open: " << argv[3] << endl;
-            ret = -1;
+        // The symbols are the only output, no banner
+        if (options.symbolize) {
+            ret = RunSymbolize(vector<string>(argv + 1, argv + argc), options.addressesPath, options.jobs);
             goto exit;
         }
 
-        if (!g_silentMode)
-            cout << "Processing settings..." << endl;
+        if (!options.silentMode)
+            cout   <<  "\n" \
+                            "3DS Game eXtension Tool " TOOL_VERSION "\n" \
+                            "--------------------------\n\n";
 
-        // Parse yaml
-        settings = YAML::Load(settingsFile);
+        if (!options.daemonSocket.empty()) {
+            // Later requests reuse the libraries and settings loaded by the previous ones
+            WarmState daemonState;
 
-        // Fetch version
-        header.version = GetVersion(settings);
+            if (!options.silentMode)
+                cout << "Serving the conversions on " << options.daemonSocket << endl;
 
-        // Fetch Infos
-        GetInfos(settings);
+            ret = RunDaemon(options.daemonSocket, TOOL_VERSION, [&daemonState](const vector<string> &args) {
+                vector<const char *> argv;
 
-        // Fetch titles
-        GetTitles(settings);
+                if (!IsForwardable(args)) {
+                    cerr << "This command can't be run by the daemon!" << endl;
+                    return -1;
+                }
 
-        // Fetch compatibility and memory size
-        header.infos.compatibility = static_cast<u32>(GetCompatibility(settings));
-        header.infos.memoryRegionSize = static_cast<u32>(GetMemorySize(settings));
-        header.infos.eventsSelfManaged = static_cast<u32>(GetEventsSelfManaged(settings));
-        header.infos.swapNotNeeded = static_cast<u32>(GetSwapNotNeeded(settings));
+                for (const string &arg : args)
+                    argv.push_back(arg.c_str());
+
+                return RunTool(argv.size(), argv.data(), &daemonState);
+            });
+            goto exit;
+        }
 
-        if (!g_silentMode)
-            cout << "Creating file..." << endl;
+        if (!options.cacheDir.empty())
+            session.cache.reset(new ConversionCache(options.cacheDir, options.cacheMaxSize));
 
-        // Reserve header place
-        outputFile.write((const char *)&header, sizeof(_3gx_Header));
-        outputFile.flush();
+        if (!options.enclibPath.empty())
+            session.encLib = LoadEncLib(session, options.enclibPath, stats);
 
-        if (!g_title.empty()) {
-            header.infos.titleLen = g_title.size() + 1;
-            header.infos.titleMsg = (u32)outputFile.tellp();
-            outputFile << g_title << '\0';
-            outputFile.flush();
-        }
+        if (!options.batchManifest.empty()) {
+            vector<ConvertJob> jobs = LoadManifest(options.batchManifest);
 
-        if (!g_author.empty()) {
-            header.infos.authorLen = g_author.size() + 1;
-            header.infos.authorMsg = (u32)outputFile.tellp();
-            outputFile << g_author << '\0';
-            outputFile.flush();
-        }
+            if (!options.depfilePath.empty())
+                throw runtime_error("--MF can't name the depfile of every batch job, use --MD instead!");
 
-        if (!g_summary.empty()) {
-            header.infos.summaryLen = g_summary.size() + 1;
-            header.infos.summaryMsg = (u32)outputFile.tellp();
-            outputFile << g_summary << '\0';
-            outputFile.flush();
-        }
+            // The jobs already keep the cores busy, each one only splits its work over its share of them
+            u32 cores = max(1u, thread::hardware_concurrency());
+            u32 concurrentJobs = min<u32>(options.jobs ? options.jobs : cores, max<size_t>(jobs.size(), 1));
 
-        if (!g_description.empty()) {
-            header.infos.descriptionLen = g_description.size() + 1;
-            header.infos.descriptionMsg = (u32)outputFile.tellp();
-            outputFile << g_description << '\0';
-            outputFile.flush();
+            session.options.convert.maxThreads = max(1u, cores / concurrentJobs);
+            ret = RunBatch(session, jobs, stats);
+
+            if (session.cache)
+                session.cache->Evict();
+            goto stats;
         }
 
-        if (!g_targets.empty()) {
-            header.targets.count = g_targets.size();
-            header.targets.titles = (u32)outputFile.tellp();
-            outputFile.write((const char *)g_targets.data(), 4 * g_targets.size());
-            outputFile.flush();
+        if (argc < 4) {
+            if (!options.silentMode)
+                PrintUsage(argv[0]);
+            ret = -1;
+            goto exit;
         }
 
-        elfConvert.WriteToFile(header, outputFile, !g_discardSymbols);
+        // There's no partial output to remove from a pipe
+        if (string(argv[3]) != "-")
+            outputPath = argv[3];
 
-        // Write updated header to file
-        outputFile.seekp(0, ios::beg);
-        outputFile.write((const char *)&header, sizeof(_3gx_Header));
-        outputFile.flush();
-        codeFile.close();
-        outputFile.close();
+        ConvertPlugin(session, {argv[1], argv[2], argv[3]}, cout, !options.silentMode, stats);
 
-        if (!g_silentMode)
-            cout << "Done" << endl;
+        if (session.cache)
+            session.cache->Evict();
+
+        stats:
+        if (!options.statsFormat.empty()) {
+            process.wallNs = GetWallTimeNs() - process.wallNs;
+            process.cpuNs = GetProcessCpuTimeNs() - process.cpuNs;
+            process.peakRssKiB = GetPeakRssKiB();
+            process.allocations = GetAllocationCount() - allocationsStart;
+            WriteStats(options, stats, process);
+        }
     }
 
     catch (exception &e) {
-        remove(argv[3]);
+        if (outputPath)
+            remove(outputPath);
         cerr << "An exception occured: " << e.what() << endl;
         ret = -1;
         goto exit;
     }
 
     exit:
+    CountAllocations(false);
+
+    if (!options.tracePath.empty() && !WriteTrace(options.tracePath)) {
+        cerr << "Couldn't write the trace: " << options.tracePath << endl;
+        ret = -1;
+    }
+
+    cout.rdbuf(stdoutBuffer);
     return ret;
-}
\ No newline at end of file
+}
+
+int main(int argc, const char **argv) {
+    const char *socketPath = getenv(DAEMON_SOCKET_ENV);
+    vector<string> args(argv, argv + argc);
+    int ret;
+
+    // Handed to the daemon when one is running, everything is already loaded there
+    if (socketPath && *socketPath && IsForwardable(args) && ForwardToDaemon(socketPath, TOOL_VERSION, args, ret))
+        return ret;
+
+    return RunTool(argc, argv, nullptr);
+}